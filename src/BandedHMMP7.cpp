@@ -65,7 +65,7 @@ BandedHMMP7::BandedHMMP7() :
 BandedHMMP7::BandedHMMP7(const string& name, int K, const DegenAlphabet* abc) :
 		name(name), K(K), L(0), abc(abc),
 		hmmBg(K), nSeq(0), effN(0),
-		cs2ProfileIdx() /* zero initiation */, profile2CSIdx() /* zero initiation */,
+		cs2ProfileIdx(1) /* zero initiation */, profile2CSIdx(K + 1) /* zero initiation */,
 		wingRetracted(false) {
 	if(!(abc->getAlias() == "DNA" && abc->getSize() == 4))
 		throw invalid_argument("BandedHMMP7 only supports DNA alphabet");
@@ -82,7 +82,7 @@ BandedHMMP7::BandedHMMP7(const string& name, int K, const DegenAlphabet* abc) :
 BandedHMMP7::BandedHMMP7(const string& name, const string& hmmVersion, int K, const DegenAlphabet* abc) :
 		name(name), hmmVersion(hmmVersion), K(K), L(0), abc(abc),
 		hmmBg(K), nSeq(0), effN(0),
-		cs2ProfileIdx() /* zero initiation */, profile2CSIdx() /* zero initiation */,
+		cs2ProfileIdx(1) /* zero initiation */, profile2CSIdx(K + 1) /* zero initiation */,
 		wingRetracted(false) {
 	if(!(abc->getAlias() == "DNA" && abc->getSize() == 4))
 		throw invalid_argument("BandedHMMP7 only supports DNA alphabet");
@@ -189,8 +189,11 @@ istream& operator>>(istream& in, BandedHMMP7& hmm) {
 						return in;
 					}
 					iss >> tmp;
-					hmm.cs2ProfileIdx[atoi(tmp.c_str())] = k;
-					hmm.profile2CSIdx[k] = atoi(tmp.c_str());
+					int csIdx = atoi(tmp.c_str());
+					if(csIdx >= hmm.cs2ProfileIdx.size())
+						hmm.cs2ProfileIdx.resize(csIdx + 1);
+					hmm.cs2ProfileIdx[csIdx] = k;
+					hmm.profile2CSIdx[k] = csIdx;
 					hmm.setLocOptTag("MAP", tmp, k);
 					/* read other optional tags */
 					if(!hmm.getOptTag("CONS").empty()) { /* this tag is present, regarding yes or no */
@@ -396,9 +399,9 @@ BandedHMMP7& BandedHMMP7::build(const MSA& msa, double symfrac,
 	else
 		this->name = msa.getName();
 	abc = msa.getAbc();
-	reset_index();
 	/* set/determine the bHMM size */
 	L = msa.getCSLen();
+	reset_index();
 	const unsigned N = msa.getNumSeq();
 	unsigned k = 0;
 
@@ -468,6 +471,8 @@ BandedHMMP7& BandedHMMP7::build(const MSA& msa, double symfrac,
 		double w = msa.getSeqWeight(i);
 		int start = msa.seqStart(i);
 		int end = msa.seqEnd(i);
+		if(start < 0) /* no residual in this seq, i.e. in a sliced MSA */
+			continue;
 		int8_t bStart = msa.encodeAt(i, start);
 		p7_state smStart = determineMatchingState(cs2ProfileIdx, start + 1, bStart);
 		Tmat[0](M, smStart) += w;
@@ -521,9 +526,9 @@ BandedHMMP7& BandedHMMP7::build(const MSA& msa, double symfrac,
 		int map = profile2CSIdx[k];
 		sprintf(value, "%d", map);
 		setLocOptTag("MAP", value, k);
-		char c = msa.CSBaseAt(map);
+		char c = msa.CSBaseAt(map - 1); /* MAP is 1-based */
 		int8_t b = abc->encode(c);
-		if(msa.wIdentityAt(map) < CONS_THRESHOLD)
+		if(msa.wIdentityAt(map - 1) < CONS_THRESHOLD)
 			c = ::tolower(c);
 		setLocOptTag("CONS", string() + c, k);
 	}
@@ -550,6 +555,7 @@ string BandedHMMP7::trim(const string& str, const string& whitespace) {
 
 void BandedHMMP7::setProfileSize(int size) {
 	K = size; // set self size
+	profile2CSIdx.resize(K + 1);
 	hmmBg.setSize(size); // set bg size
 	init_transition_params();
 	init_emission_params();
@@ -690,16 +696,16 @@ void BandedHMMP7::init_limits() {
 }
 
 void BandedHMMP7::reset_index() {
-	/* position 0 is dummy for all indices */
-	for(int i = 0; i < kMaxProfile; ++i)
-		cs2ProfileIdx[i] = 0;
-	for(int i = 1; i < kMaxCS; ++i)
-		profile2CSIdx[i] = 0;
+	/* position 0 is dummy for all indices, profile size is at most L */
+	cs2ProfileIdx.assign(L + 1, 0);
+	profile2CSIdx.assign(L + 1, 0);
 }
 
 void BandedHMMP7::extend_index() {
 	/* extend index upto maxLen */
-	for(int i = profile2CSIdx[K] + 1; i <= L && i < kMaxProfile; ++i)
+	if(cs2ProfileIdx.size() < L + 1)
+		cs2ProfileIdx.resize(L + 1);
+	for(int i = profile2CSIdx[K] + 1; i <= L; ++i)
 		cs2ProfileIdx[i] = K;
 }
 
@@ -892,51 +898,31 @@ void BandedHMMP7::calcViterbiScores(const PrimarySeq& seq,
 
 BandedHMMP7::ViterbiAlignPath BandedHMMP7::buildAlignPath(const CSLoc& csLoc, int csFrom, int csTo) const {
 //	cerr << "csStart:" << csLoc.start << " csEnd:" << csLoc.end << " csFrom:" << csFrom << " csTo:" << csTo <<
-//			" CSLen:" << csLoc.CS.length() << " CS:" << csLoc.CS << endl;
+//			" nGap:" << csLoc.nGap << endl;
 	assert(csLoc.isValid(csFrom, csTo));
 
-	/* calculate profile start, end and path */
+	/* calculate profile start, end and # of profile positions covered */
 	int start = 0;
 	int end = 0;
-	int from = 0;
-	int to = 0;
-	int nIns = 0;
-	int nDel = 0;
-
-	int i = csFrom;
-	int j = csLoc.start;
-	for(string::const_iterator it = csLoc.CS.begin(); it != csLoc.CS.end(); ++it) {
+	int nProfile = 0;
+	for(int j = csLoc.start; j <= csLoc.end; ++j) {
 		int k = getProfileLoc(j); // position on profile
-//		cerr << "i:" << i << " j:" << j << " k:" << k << endl;
-//		cerr << "vpath.L:" << vpath.L << " vpath.K:" << vpath.K << endl;
-
-		bool nonGap = abc->isSymbol(*it);
-
-		if(from == 0 && nonGap)
-			from = i;
-		if(nonGap)
-			to = i;
 		if(k != 0) { // a non-D loc on profile
 			if(start == 0) // first time a non-D loc on profile
 				start = k;
 			end = k; // keep updating
-			if(!nonGap) // a deletion
-				nDel++;
-		}
-		else { // a D loc on profile
-			if(nonGap) // an insertion
-				nIns++;
+			nProfile++;
 		}
-		j++; // update j
-		if(nonGap)
-			i++; // update i
 	}
-//	cerr << "vpath.path:" << vpath.alnPath << endl;
-//	cerr << "start: " << start << " end: " << end << endl;
-//	cerr << "i:" << i << " j:" << j << " csTo:" << csTo << " csEnd:" << csLoc.end << endl;
-	assert(i == csTo + 1 && j == csLoc.end + 1);
 
-	return ViterbiAlignPath(start, end, from, to, nIns, nDel);
+	/*
+	 * the located seq always starts and ends with non-gaps, and only the # of gaps are known,
+	 * so use the max possible # of insertions and deletions relative to the profile
+	 */
+	int nIns = std::min(csTo - csFrom + 1, csLoc.end - csLoc.start + 1 - nProfile);
+	int nDel = std::min(csLoc.nGap, nProfile);
+
+	return ViterbiAlignPath(start, end, csFrom, csTo, nIns, nDel);
 }
 
 void BandedHMMP7::buildViterbiTrace(const ViterbiScores& vs, ViterbiAlignTrace& vtrace) const {
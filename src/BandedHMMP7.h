@@ -275,8 +275,6 @@ public:
 	static const int kNSP = 4; // number of special states
 	static const int kNS = kNM + kNSP; // number of total states
 	static const string HMM_TAG;
-	static const int kMaxProfile = UINT16_MAX + 1;
-	static const int kMaxCS = UINT16_MAX + 1;
 	static const double kMinGapFrac; // minimum gap fraction comparing to the profile
 	static const double CONS_THRESHOLD; // threshold for print upper-case consensus residues
 	static const double DEFAULT_ERE; // target mean average relative entropy of the model
@@ -383,7 +381,7 @@ public:
 	 * @return the 1-based position relative to the profile, or 0 is not invalid or unmatched column
 	 */
 	int getProfileLoc(int idx) const {
-		return idx < kMaxProfile ? cs2ProfileIdx[idx] : 0;
+		return idx < cs2ProfileIdx.size() ? cs2ProfileIdx[idx] : 0;
 	}
 
 	/**
@@ -392,7 +390,7 @@ public:
 	 * @return the 1-based position relative to the consensus sequence, or 0 if out of range
 	 */
 	int getCSLoc(int idx) const {
-		return idx < kMaxCS ? profile2CSIdx[idx] : 0;
+		return idx < profile2CSIdx.size() ? profile2CSIdx[idx] : 0;
 	}
 
 	/**
@@ -429,8 +427,8 @@ public:
 
 	/**
 	 * build a known VPath using calculated coordinates
-	 * @param csStart  1-based consensus start
-	 * @param csEnd  1-based consensus end
+	 * the # of insertions and deletions are upper bounds derived from the # of gaps in csLoc
+	 * @param csLoc  located consensus region
 	 * @param csFrom  1-based seq start
 	 * @param csTo  1-based seq end
 	 * @return  a new VPath
@@ -544,8 +542,8 @@ private:
 	//VectorXi delBeforeLimit; /* Minimum allowed deletions before given position 1..K, with 0 as dummy position */
 	//VectorXi delAfterLimit; /* Minimum allowed deletions after given position 1..K, with 0 as dummy position */
 
-	int cs2ProfileIdx[kMaxProfile + 1]; // MAP index from consensus index -> profile index
-	int profile2CSIdx[kMaxCS + 1]; // MAP index from profile index -> consensus index
+	vector<int> cs2ProfileIdx; // MAP index from consensus index -> profile index, 0..L
+	vector<int> profile2CSIdx; // MAP index from profile index -> consensus index, 0..K
 
 	BandedHMMP7Bg hmmBg; // background HMMP7 profile
 
@@ -710,7 +708,7 @@ private:
 	/**
 	 * Determine the p7 matching state (M, I, D) on a consensus sequence
 	 */
-	static p7_state determineMatchingState(const int* cs2ProfileIdx, int loc, int8_t base) {
+	static p7_state determineMatchingState(const vector<int>& cs2ProfileIdx, int loc, int8_t base) {
 		bool isPos = cs2ProfileIdx[loc] != cs2ProfileIdx[loc - 1];
 		return isPos && base >= 0 ? M : isPos && base < 0 ? D : !isPos && base >= 0 ? I : P;
 	}
@@ -0,0 +1,277 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * BranchArena.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include <new>
+#include <cmath>
+#include <unistd.h>
+#include "BranchArena.h"
+
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define BRANCH_ARENA_MMAP 1
+#endif
+
+namespace EGriceLab {
+namespace HmmUFOtu {
+
+BranchArena::BranchArena() : singlePrec(false), likBuf(4, 0), likFBuf(4, 0), mapAddr(NULL), mapLen(0),
+		lik(NULL, 4, 0), likF(NULL, 4, 0), scale(NULL, 0) {
+	rebind();
+}
+
+BranchArena::BranchArena(const BranchArena& other) : singlePrec(other.singlePrec),
+		likBuf(4, 0), likFBuf(4, 0), mapAddr(NULL), mapLen(0),
+		lik(NULL, 4, 0), likF(NULL, 4, 0), scale(NULL, 0) {
+	likBuf = other.lik;
+	likFBuf = other.likF;
+	scaleBuf = other.scale;
+	rebind();
+}
+
+BranchArena::~BranchArena() {
+	unmap();
+}
+
+BranchArena& BranchArena::operator=(const BranchArena& other) {
+	if(this == &other)
+		return *this;
+	/* copy views before releasing any mapped storage */
+	Matrix4Xd otherLik = other.lik;
+	Matrix4Xf otherLikF = other.likF;
+	RowVectorXi otherScale = other.scale;
+	unmap();
+	singlePrec = other.singlePrec;
+	likBuf.swap(otherLik);
+	likFBuf.swap(otherLikF);
+	scaleBuf.swap(otherScale);
+	rebind();
+	return *this;
+}
+
+void BranchArena::setSinglePrec(bool flag) {
+	if(flag == singlePrec)
+		return;
+	materialize();
+	if(flag) {
+		likFBuf = likBuf.cast<float>();
+		likBuf.resize(4, 0);
+	}
+	else {
+		likBuf = likFBuf.cast<double>();
+		likFBuf.resize(4, 0);
+	}
+	singlePrec = flag;
+	rebind();
+}
+
+void BranchArena::grow(long nCol, double fill) {
+	long nCol0 = cols();
+	if(nCol0 >= nCol)
+		return;
+	materialize();
+	if(singlePrec) {
+		likFBuf.conservativeResize(4, nCol);
+		likFBuf.rightCols(nCol - nCol0).setConstant(fill);
+	}
+	else {
+		likBuf.conservativeResize(4, nCol);
+		likBuf.rightCols(nCol - nCol0).setConstant(fill);
+	}
+	scaleBuf.conservativeResize(nCol);
+	scaleBuf.tail(nCol - nCol0).setZero();
+	rebind();
+}
+
+istream& BranchArena::read(istream& in, long nCol, LikEncoding enc) {
+	unmap();
+	singlePrec = enc != DOUBLE_LIK;
+	switch(enc) {
+	case DOUBLE_LIK:
+		likBuf.resize(4, nCol);
+		likFBuf.resize(4, 0);
+		in.read((char*) likBuf.data(), sizeof(double) * likBuf.size());
+		break;
+	case FLOAT_LIK:
+		likBuf.resize(4, 0);
+		likFBuf.resize(4, nCol);
+		in.read((char*) likFBuf.data(), sizeof(float) * likFBuf.size());
+		break;
+	case QUANT16_LIK: {
+		likBuf.resize(4, 0);
+		vector<uint16_t> code(4 * nCol);
+		if(nCol > 0)
+			in.read((char*) &code[0], sizeof(uint16_t) * code.size());
+		decodeCodes(nCol > 0 ? &code[0] : NULL, nCol);
+		break;
+	}
+	}
+	scaleBuf.resize(nCol);
+	in.read((char*) scaleBuf.data(), sizeof(int) * scaleBuf.size());
+	rebind();
+	return in;
+}
+
+bool BranchArena::mapFile(const string& fn, std::streamoff offset, long nCol, LikEncoding enc) {
+#ifdef BRANCH_ARENA_MMAP
+	const size_t len = numBytes(nCol, enc);
+	if(len == 0 || offset < 0 || offset % ::sysconf(_SC_PAGESIZE) != 0)
+		return false;
+	int fd = ::open(fn.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if(::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t> (offset + len)) { /* truncated file */
+		::close(fd);
+		return false;
+	}
+	void* addr = ::mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+	::close(fd); /* the mapping is kept after closing */
+	if(addr == MAP_FAILED)
+		return false;
+
+	unmap();
+	likBuf.resize(4, 0);
+	likFBuf.resize(4, 0);
+	scaleBuf.resize(0);
+	singlePrec = enc != DOUBLE_LIK;
+	mapAddr = addr;
+	mapLen = len;
+	char* likData = static_cast<char*> (addr);
+	int* scaleData = reinterpret_cast<int*> (likData + 4 * nCol * likSize(enc));
+	switch(enc) {
+	case DOUBLE_LIK:
+		rebind(reinterpret_cast<double*> (likData), NULL, scaleData, nCol);
+		break;
+	case FLOAT_LIK:
+		rebind(NULL, reinterpret_cast<float*> (likData), scaleData, nCol);
+		break;
+	case QUANT16_LIK: /* the quantized lik are decoded into owned storage, their mapped pages are only read once */
+		decodeCodes(reinterpret_cast<const uint16_t*> (likData), nCol);
+		rebind(NULL, likFBuf.data(), scaleData, nCol);
+		break;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+ostream& BranchArena::writeLik(ostream& out, long k, long n, LikEncoding enc) const {
+	switch(enc) {
+	case DOUBLE_LIK:
+		if(!singlePrec)
+			out.write((const char*) lik.col(k).data(), sizeof(double) * 4 * n);
+		else {
+			const Matrix4Xd& buf = likF.middleCols(k, n).cast<double>();
+			out.write((const char*) buf.data(), sizeof(double) * buf.size());
+		}
+		break;
+	case FLOAT_LIK:
+		if(singlePrec)
+			out.write((const char*) likF.col(k).data(), sizeof(float) * 4 * n);
+		else {
+			const Matrix4Xf& buf = lik.middleCols(k, n).cast<float>();
+			out.write((const char*) buf.data(), sizeof(float) * buf.size());
+		}
+		break;
+	case QUANT16_LIK: {
+		vector<uint16_t> buf(4 * n);
+		for(long i = 0; i < 4 * n; ++i)
+			buf[i] = encodeLik(singlePrec ? likF.data()[4 * k + i] : lik.data()[4 * k + i]);
+		if(n > 0)
+			out.write((const char*) &buf[0], sizeof(uint16_t) * buf.size());
+		break;
+	}
+	}
+	return out;
+}
+
+uint16_t BranchArena::encodeLik(double x) {
+	if(x < 0)
+		return INVALID_CODE;
+	if(x == 0)
+		return ZERO_CODE;
+	double e = -::log(x) / M_LN2; /* -log2(x) */
+	if(e > QUANT_LOG2_RANGE) /* underflow */
+		return ZERO_CODE;
+	if(e < 0)
+		e = 0;
+	return static_cast<uint16_t> (1 + ::floor(e * QUANT_STEPS / QUANT_LOG2_RANGE + 0.5));
+}
+
+/* build the lookup table of all decoded 16-bit codes */
+static vector<float> buildDecodeTable() {
+	vector<float> table(BranchArena::INVALID_CODE + 1);
+	table[BranchArena::ZERO_CODE] = 0;
+	for(int code = BranchArena::ZERO_CODE + 1; code < BranchArena::INVALID_CODE; ++code)
+		table[code] = ::exp(-(code - 1) * M_LN2 * BranchArena::QUANT_LOG2_RANGE / BranchArena::QUANT_STEPS);
+	table[BranchArena::INVALID_CODE] = -1;
+	return table;
+}
+
+const float* BranchArena::decodeTable() {
+	static const vector<float> table = buildDecodeTable(); /* initialized once, thread-safe */
+	return &table[0];
+}
+
+void BranchArena::decodeCodes(const uint16_t* code, long nCol) {
+	likFBuf.resize(4, nCol);
+	const float* table = decodeTable();
+	float* dest = likFBuf.data();
+	for(long i = 0; i < 4 * nCol; ++i)
+		dest[i] = table[code[i]];
+}
+
+void BranchArena::materialize() {
+	if(!isMapped())
+		return;
+	likBuf = lik;
+	likFBuf = likF;
+	scaleBuf = scale;
+	unmap();
+	rebind();
+}
+
+void BranchArena::unmap() {
+#ifdef BRANCH_ARENA_MMAP
+	if(isMapped())
+		::munmap(mapAddr, mapLen);
+#endif
+	mapAddr = NULL;
+	mapLen = 0;
+}
+
+void BranchArena::rebind(double* likData, float* likFData, int* scaleData, long nCol) {
+	/* Eigen::Map can only be re-pointed by placement new */
+	new (&lik) LikMap(likData, 4, singlePrec ? 0 : nCol);
+	new (&likF) LikFMap(likFData, 4, singlePrec ? nCol : 0);
+	new (&scale) ScaleMap(scaleData, nCol);
+}
+
+} /* namespace HmmUFOtu */
+} /* namespace EGriceLab */
@@ -0,0 +1,184 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * BranchArena.h
+ *  Storage of the scaled lik and lik scale of all branches of a PTUnrooted tree,
+ *  either owned in memory, or mapped from a database file with copy-on-write pages shared between processes
+ *  The lik are stored in either double or single precision, accessed through Eigen::Map views of the storage
+ *  The lik can also be stored 16-bit log-quantized, and are decoded into single precision when loaded
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#ifndef SRC_BRANCHARENA_H_
+#define SRC_BRANCHARENA_H_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstddef>
+#include <stdint.h>
+#include <Eigen/Dense>
+
+namespace EGriceLab {
+namespace HmmUFOtu {
+
+using std::string;
+using std::vector;
+using std::istream;
+using std::ostream;
+using Eigen::Matrix4Xd;
+using Eigen::Matrix4Xf;
+using Eigen::RowVectorXi;
+
+class BranchArena {
+public:
+	typedef Eigen::Map<Matrix4Xd> LikMap;
+	typedef Eigen::Map<Matrix4Xf> LikFMap;
+	typedef Eigen::Map<RowVectorXi> ScaleMap;
+
+	/** storage encodings of lik */
+	enum LikEncoding {
+		DOUBLE_LIK, /* double precision */
+		FLOAT_LIK, /* single precision */
+		QUANT16_LIK /* 16-bit log-quantized, decoded into single precision */
+	};
+
+	/* constructors */
+	/** construct an empty arena in double precision */
+	BranchArena();
+
+	/** copy constructor, a mapped arena is copied into owned storage */
+	BranchArena(const BranchArena& other);
+
+	/** destructor, unmap any mapped storage */
+	~BranchArena();
+
+	/** assignment operator, a mapped arena is copied into owned storage */
+	BranchArena& operator=(const BranchArena& other);
+
+	/* member methods */
+	/** get number of columns */
+	long cols() const {
+		return scale.cols();
+	}
+
+	/** test whether the lik are stored in single precision */
+	bool isSinglePrec() const {
+		return singlePrec;
+	}
+
+	/** test whether this arena is mapped from a file */
+	bool isMapped() const {
+		return mapAddr != NULL;
+	}
+
+	/** convert the stored lik to single or double precision */
+	void setSinglePrec(bool flag);
+
+	/**
+	 * grow this arena to at least nCol columns, with new lik set to fill and new scale set to 0
+	 */
+	void grow(long nCol, double fill);
+
+	/**
+	 * read nCol columns of lik in given encoding followed by their scale from a binary input into owned storage,
+	 * quantized lik are decoded into single precision
+	 */
+	istream& read(istream& in, long nCol, LikEncoding enc);
+
+	/**
+	 * map nCol columns of lik in given encoding followed by their scale from a file at a given page-aligned offset,
+	 * as stored by read(), the mapped pages are private and only copied when written,
+	 * quantized lik are decoded into owned single precision storage and only their scale stays mapped
+	 * @return  true if mapped successfully, or false if memory mapping is not supported or failed
+	 */
+	bool mapFile(const string& fn, std::streamoff offset, long nCol, LikEncoding enc);
+
+	/** write n columns of lik starting at column k in given encoding to a binary output */
+	ostream& writeLik(ostream& out, long k, long n, LikEncoding enc) const;
+
+	/** get the number of bytes of nCol columns of lik in given encoding and their scale, as stored by read() and mapFile() */
+	static size_t numBytes(long nCol, LikEncoding enc) {
+		return nCol * (4 * likSize(enc) + sizeof(int));
+	}
+
+	/** get the size of a lik value in given encoding */
+	static size_t likSize(LikEncoding enc) {
+		return enc == DOUBLE_LIK ? sizeof(double) : enc == FLOAT_LIK ? sizeof(float) : sizeof(uint16_t);
+	}
+
+	/**
+	 * encode a lik value by 16-bit log-quantization,
+	 * values in [2^-QUANT_LOG2_RANGE, 1] are quantized with a max relative error of 2^(QUANT_LOG2_RANGE / QUANT_STEPS / 2) - 1 (about 0.07%),
+	 * larger values are encoded as 1, smaller values as 0, and negative values (invalid marker) as -1
+	 */
+	static uint16_t encodeLik(double x);
+
+	/** decode a 16-bit log-quantized lik value */
+	static float decodeLik(uint16_t code) {
+		return decodeTable()[code];
+	}
+
+private:
+	/** decode nCol columns of quantized lik into the owned single precision storage */
+	void decodeCodes(const uint16_t* code, long nCol);
+
+	/** get the lookup table of all decoded 16-bit codes, built once on first use */
+	static const float* decodeTable();
+
+	/** copy any mapped storage into owned storage, and unmap it */
+	void materialize();
+
+	/** release the mapped storage, if any */
+	void unmap();
+
+	/** point the views to the owned storage */
+	void rebind() {
+		rebind(likBuf.data(), likFBuf.data(), scaleBuf.data(), scaleBuf.cols());
+	}
+
+	/** point the views to given storage of nCol columns */
+	void rebind(double* likData, float* likFData, int* scaleData, long nCol);
+
+	bool singlePrec;
+	Matrix4Xd likBuf; /* owned double precision lik */
+	Matrix4Xf likFBuf; /* owned single precision lik */
+	RowVectorXi scaleBuf; /* owned scale */
+	void* mapAddr; /* start of the mapped region, NULL if not mapped */
+	size_t mapLen; /* length of the mapped region */
+
+public:
+	/* views of either the owned or the mapped storage */
+	LikMap lik; /* double precision lik, empty if singlePrec is set */
+	LikFMap likF; /* single precision lik, empty if singlePrec is not set */
+	ScaleMap scale; /* lik scale */
+
+	static const size_t PAGE_ALIGN = 65536; /* file alignment of a mappable arena, a multiple of all common page sizes */
+	static const int QUANT_LOG2_RANGE = 128; /* range of -log2(lik) of quantized values */
+	static const int QUANT_STEPS = 65533; /* number of quantization steps, code 0 is 0, code 65535 is -1 */
+	static const uint16_t ZERO_CODE = 0;
+	static const uint16_t INVALID_CODE = 65535;
+};
+
+} /* namespace HmmUFOtu */
+} /* namespace EGriceLab */
+
+#endif /* SRC_BRANCHARENA_H_ */
@@ -32,6 +32,7 @@
 #include "HmmUFOtuConst.h"
 #include "BitSequenceBuilder.h"
 #include "BitSequenceBuilderRRR.h"
+#include "BitSequenceRG.h"
 #include "Mapper.h"
 #include "MapperNone.h"
 
@@ -40,13 +41,16 @@ using namespace cds_static;
 namespace EGriceLab {
 namespace HmmUFOtu {
 
-int32_t CSFMIndex::count(const string& pattern) const {
+const uint32_t CSFMIndex::FORMAT_MAGIC;
+const uint32_t CSFMIndex::FORMAT_VERSION;
+
+int64_t CSFMIndex::count(const string& pattern) const {
 	int32_t m = pattern.length();
 	if(m == 0)
 		return 0; /* empty pattern matches to nothing */
 
-    int32_t start = 0;
-    int32_t end = concatLen;
+    int64_t start = 0;
+    int64_t end = concatLen;
 	/* search pattern left-to-right, as bwt is the reverse FM-index */
     for(string::const_reverse_iterator c = pattern.rbegin(); c != pattern.rend() && start <= end; ++c) {
         int8_t b = abc->encode(*c) + 1; /* map pattern to our alphabet */
@@ -66,8 +70,8 @@ vector<CSLoc> CSFMIndex::locate(const string& pattern) const {
 	vector<CSLoc> locs;
 	if(pattern.empty())
 		return locs; /* empty pattern matches to nothing */
-    int32_t start = 0; /* 1-based */
-    int32_t end = concatLen;
+    int64_t start = 0; /* 1-based */
+    int64_t end = concatLen;
 	/* while there are possible occs and pattern not done */
     for (string::const_reverse_iterator c = pattern.rbegin(); c != pattern.rend() && start <= end; ++c) {
       int8_t b = abc->encode(*c) + 1; /* map pattern to 1 .. size */
@@ -81,11 +85,11 @@ vector<CSLoc> CSFMIndex::locate(const string& pattern) const {
       }
     }
 
-    for(int32_t i = start; i <= end; ++i) {
+    for(int64_t i = start; i <= end; ++i) {
     	uint32_t concatStart = accessSA(i); /* 1-based */
-    	int32_t csStart = concat2CS[concatStart];
-    	int32_t csEnd = concat2CS[concatStart + pattern.length() - 1];
-    	locs.push_back(CSLoc(csStart, csEnd, extractCS(concatStart, pattern)));
+    	int32_t csStart = concat2CSAt(concatStart);
+    	int32_t csEnd = concat2CSAt(concatStart + pattern.length() - 1);
+    	locs.push_back(CSLoc(csStart, csEnd, csEnd - csStart + 1 - static_cast<int32_t>(pattern.length())));
     }
     return locs;
 }
@@ -93,8 +97,8 @@ vector<CSLoc> CSFMIndex::locate(const string& pattern) const {
 CSLoc CSFMIndex::locateFirst(const string& pattern) const {
 	if(pattern.empty())
 		return CSLoc(); /* empty pattern matches to nothing */
-	int32_t start = 0;
-	int32_t end = concatLen;
+	int64_t start = 0;
+	int64_t end = concatLen;
 	/* while there are possible occs and pattern not done */
 	for (string::const_reverse_iterator c = pattern.rbegin(); c != pattern.rend() && start <= end; ++c) {
 		int8_t b = abc->encode(*c) + 1; /* map pattern to 1 .. size */
@@ -110,9 +114,9 @@ CSLoc CSFMIndex::locateFirst(const string& pattern) const {
 
 	if(start <= end) {
 		uint32_t concatStart = accessSA(start); /* 1-based */
-    	int32_t csStart = concat2CS[concatStart];
-    	int32_t csEnd = concat2CS[concatStart + pattern.length() - 1];
-		return CSLoc(csStart, csEnd, extractCS(concatStart, pattern));
+    	int32_t csStart = concat2CSAt(concatStart);
+    	int32_t csEnd = concat2CSAt(concatStart + pattern.length() - 1);
+		return CSLoc(csStart, csEnd, csEnd - csStart + 1 - static_cast<int32_t>(pattern.length()));
 	}
 	else
 		return CSLoc();
@@ -121,8 +125,8 @@ CSLoc CSFMIndex::locateFirst(const string& pattern) const {
 CSLoc CSFMIndex::locateOne(const string& pattern) const {
 	if(pattern.empty())
 		return CSLoc(); /* empty pattern matches to nothing */
-    int32_t start = 0;
-    int32_t end = concatLen;
+    int64_t start = 0;
+    int64_t end = concatLen;
 	/* while there are possible occs and pattern not done */
     for (string::const_reverse_iterator c = pattern.rbegin(); c != pattern.rend() && start <= end; ++c) {
     	int8_t b = abc->encode(*c) + 1; /* map pattern to 1 .. size */
@@ -136,22 +140,136 @@ CSLoc CSFMIndex::locateOne(const string& pattern) const {
         }
     }
     if(start <= end) {
-    	int32_t i = start + rand() % (end - start + 1);
+    	int64_t i = pickSA(pattern, start, end);
     	uint32_t concatStart = accessSA(i); // random 1-based position
-    	int32_t csStart = concat2CS[concatStart];
-    	int32_t csEnd = concat2CS[concatStart + pattern.length() - 1];
-    	return CSLoc(csStart, csEnd, extractCS(concatStart, pattern));
+    	int32_t csStart = concat2CSAt(concatStart);
+    	int32_t csEnd = concat2CSAt(concatStart + pattern.length() - 1);
+    	return CSLoc(csStart, csEnd, csEnd - csStart + 1 - static_cast<int32_t>(pattern.length()));
     }
     else
     	return CSLoc();
 }
 
+CSLoc CSFMIndex::locateBest(const string& pattern, double& agreement, uint32_t maxOcc) const {
+	agreement = 0;
+	if(pattern.empty())
+		return CSLoc(); /* empty pattern matches to nothing */
+	if(maxOcc == 0 || maxOcc > MAX_OCC)
+		throw invalid_argument("CSFMIndex max # of occurrences out of range");
+	int64_t start = 0;
+	int64_t end = concatLen;
+	/* while there are possible occs and pattern not done */
+	for (string::const_reverse_iterator c = pattern.rbegin(); c != pattern.rend() && start <= end; ++c) {
+		int8_t b = abc->encode(*c) + 1; /* map pattern to 1 .. size */
+		if(start == 0) {
+			start = C[b];
+			end = C[b + 1] - 1;
+		}
+		else {
+			start = LF(b, start - 1); /* LF Mapping */
+			end = LF(b, end) - 1; /* LF Mapping */
+		}
+	}
+	if(start > end)
+		return CSLoc();
+
+	/* check evenly spaced occurrences and vote for their CS positions */
+	const int32_t m = pattern.length();
+	const uint32_t nOcc = end - start + 1;
+	const uint32_t nCheck = nOcc < maxOcc ? nOcc : maxOcc;
+	int32_t csStarts[MAX_OCC];
+	int32_t csEnds[MAX_OCC];
+	uint32_t votes[MAX_OCC];
+	uint32_t nLoc = 0;
+	uint32_t best = 0;
+	for(uint32_t k = 0; k < nCheck; ++k) {
+		uint32_t concatStart = accessSA(start + static_cast<uint64_t>(k) * nOcc / nCheck); /* 1-based */
+		int32_t csStart = concat2CSAt(concatStart);
+		int32_t csEnd = concat2CSAt(concatStart + m - 1);
+		uint32_t l = 0;
+		while(l < nLoc && !(csStarts[l] == csStart && csEnds[l] == csEnd))
+			l++;
+		if(l == nLoc) { /* a new location */
+			csStarts[l] = csStart;
+			csEnds[l] = csEnd;
+			votes[l] = 0;
+			nLoc++;
+		}
+		votes[l]++;
+		if(votes[l] > votes[best])
+			best = l;
+	}
+	agreement = static_cast<double>(votes[best]) / nCheck;
+	return CSLoc(csStarts[best], csEnds[best], csEnds[best] - csStarts[best] + 1 - m);
+}
+
+CSLoc CSFMIndex::locateOneApprox(const string& pattern, int maxMismatch, uint32_t maxStep) const {
+	if(pattern.empty())
+		return CSLoc(); /* empty pattern matches to nothing */
+	if(maxMismatch < 0 || maxMismatch > MAX_MISMATCH)
+		throw invalid_argument("CSFMIndex approximate search mismatch out of range");
+
+	/* encode the pattern once */
+	const int32_t m = pattern.length();
+	vector<int8_t> encPattern(m);
+	for(int32_t i = 0; i < m; ++i) {
+		int8_t b = abc->encode(::toupper(pattern[i])) + 1;
+		encPattern[i] = b > 0 ? b : 0; /* invalid symbols can only be matched as mismatches */
+	}
+
+	int64_t start = 0;
+	int64_t end = 0;
+	uint32_t step = maxStep;
+	if(backtrack(encPattern, m - 1, 0, concatLen, maxMismatch, step, start, end)) {
+		int64_t i = pickSA(pattern, start, end);
+		uint32_t concatStart = accessSA(i); // random 1-based position
+		int32_t csStart = concat2CSAt(concatStart);
+		int32_t csEnd = concat2CSAt(concatStart + m - 1);
+		return CSLoc(csStart, csEnd, csEnd - csStart + 1 - m);
+	}
+	else
+		return CSLoc();
+}
+
+bool CSFMIndex::backtrack(const vector<int8_t>& pattern, int32_t i, int64_t start, int64_t end, int k,
+		uint32_t& step, int64_t& hitStart, int64_t& hitEnd) const {
+	if(i < 0) { /* whole pattern matched */
+		hitStart = start;
+		hitEnd = end;
+		return true;
+	}
+	const int8_t size = abc->getSize();
+	const int8_t b0 = pattern[i];
+	/* always try the pattern base first, then mismatches if allowed */
+	for(int8_t j = 0; j <= size; ++j) {
+		int8_t b = j == 0 ? b0 : j;
+		if(b == 0 || (j > 0 && (b == b0 || k == 0)))
+			continue;
+		if(step == 0)
+			return false; /* out of budget */
+		step--;
+		int64_t newStart, newEnd;
+		if(start == 0) {
+			newStart = C[b];
+			newEnd = C[b + 1] - 1;
+		}
+		else {
+			newStart = LF(b, start - 1); /* LF Mapping */
+			newEnd = LF(b, end) - 1; /* LF Mapping */
+		}
+		if(newStart <= newEnd &&
+				backtrack(pattern, i - 1, newStart, newEnd, b == b0 ? k : k - 1, step, hitStart, hitEnd))
+			return true;
+	}
+	return false;
+}
+
 set<unsigned> CSFMIndex::locateIndex(const string& pattern) const {
     set<unsigned> idx;
 	if(pattern.empty())
 		return idx; /* empty pattern matches to nothing */
-    int32_t start = 0;
-    int32_t end = concatLen;
+    int64_t start = 0;
+    int64_t end = concatLen;
 	/* while there are possible occs and pattern not done */
     for (string::const_reverse_iterator c = pattern.rbegin(); c != pattern.rend() && start <= end; ++c) {
     	int8_t b = abc->encode(*c) + 1; /* map pattern to 1 .. size */
@@ -165,8 +283,8 @@ set<unsigned> CSFMIndex::locateIndex(const string& pattern) const {
         }
     }
 
-    for(int32_t i = start; i <= end; ++i) {
-    	int32_t k = accessSA(i); /* 0-based */
+    for(int64_t i = start; i <= end; ++i) {
+    	uint32_t k = accessSA(i); /* 0-based */
     	idx.insert(k / (csLen + 1));
     }
 
@@ -174,6 +292,10 @@ set<unsigned> CSFMIndex::locateIndex(const string& pattern) const {
 }
 
 ostream& CSFMIndex::save(ostream& out) const {
+	/* write format tag and version */
+	out.write((const char*) &FORMAT_MAGIC, sizeof(uint32_t));
+	out.write((const char*) &FORMAT_VERSION, sizeof(uint32_t));
+
 	/* save alphabet name */
 	StringUtils::saveString(abc->getName(), out);
 
@@ -181,15 +303,21 @@ ostream& CSFMIndex::save(ostream& out) const {
 	out.write(&gapCh, sizeof(char));
 
 	/* write sizes */
-	out.write((char*) &csLen, sizeof(uint16_t));
-	out.write((char*) &concatLen, sizeof(int32_t));
+	out.write((char*) &csLen, sizeof(uint32_t));
+	out.write((char*) &concatLen, sizeof(int64_t));
+	out.write((char*) &saSampleRate, sizeof(uint32_t));
+	int8_t type = saIdxType;
+	out.write((char*) &type, sizeof(int8_t));
 
 	/* write arrays and objects */
-	out.write((char*) C, (UINT8_MAX + 1) * sizeof(int32_t));
+	out.write((char*) C, (UINT8_MAX + 1) * sizeof(int64_t));
 	StringUtils::saveString(csSeq, out);
 	out.write((char*) csIdentity, (csLen + 1) * sizeof(double));
-	out.write((char*) concat2CS, (concatLen + 1) * sizeof(uint16_t));
-	out.write((char*) saSampled, (concatLen / SA_SAMPLE_RATE) * sizeof(uint32_t));
+	if(isWideCS())
+		out.write((char*) concat2CSWide, (concatLen + 1) * sizeof(uint32_t));
+	else
+		out.write((char*) concat2CS, (concatLen + 1) * sizeof(uint16_t));
+	out.write((char*) saSampled, numSASampled() * sizeof(uint32_t));
 
 	saIdx->save(out);
 	bwt->save(out);
@@ -199,6 +327,20 @@ ostream& CSFMIndex::save(ostream& out) const {
 
 istream& CSFMIndex::load(istream& in) {
 	clear(); /* clear old data, if any */
+	/* read and check format tag and version */
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	in.read((char*) &magic, sizeof(uint32_t));
+	in.read((char*) &version, sizeof(uint32_t));
+	if(in.bad())
+		return in;
+	if(magic != FORMAT_MAGIC || version != FORMAT_VERSION) {
+		cerr << "Incompatible CSFM-index format version " << (magic == FORMAT_MAGIC ? version : 1)
+				<< ", expecting " << FORMAT_VERSION << ", please rebuild the database with hmmufotu-build" << endl;
+		in.setstate(ios_base::badbit);
+		return in;
+	}
+
 	/* read alphabet by name */
 	string alphabet;
 	StringUtils::loadString(alphabet, in);
@@ -208,33 +350,46 @@ istream& CSFMIndex::load(istream& in) {
 	in.read(&gapCh, sizeof(char));
 
 	/* read sizes */
-	in.read((char*) &csLen, sizeof(uint16_t));
-	in.read((char*) &concatLen, sizeof(int32_t));
+	in.read((char*) &csLen, sizeof(uint32_t));
+	in.read((char*) &concatLen, sizeof(int64_t));
+	in.read((char*) &saSampleRate, sizeof(uint32_t));
+	int8_t type;
+	in.read((char*) &type, sizeof(int8_t));
+	saIdxType = static_cast<SA_IDX_TYPE> (type);
 
 	/* read arrays and objects */
-	in.read((char*) C, (UINT8_MAX + 1) * sizeof(int32_t));
+	in.read((char*) C, (UINT8_MAX + 1) * sizeof(int64_t));
 	StringUtils::loadString(csSeq, in);
 
 	csIdentity = new double[csLen + 1];
 	in.read((char*) csIdentity, (csLen + 1) * sizeof(double));
 
-    concat2CS = new uint16_t[concatLen + 1];
-	in.read((char*) concat2CS, (concatLen + 1) * sizeof(uint16_t));
+	if(isWideCS()) {
+		concat2CSWide = new uint32_t[concatLen + 1];
+		in.read((char*) concat2CSWide, (concatLen + 1) * sizeof(uint32_t));
+	}
+	else {
+		concat2CS = new uint16_t[concatLen + 1];
+		in.read((char*) concat2CS, (concatLen + 1) * sizeof(uint16_t));
+	}
 
-	saSampled = new uint32_t[concatLen / SA_SAMPLE_RATE + 1];
-	in.read((char*) saSampled, (concatLen / SA_SAMPLE_RATE) * sizeof(uint32_t));
+	saSampled = new uint32_t[numSASampled()];
+	in.read((char*) saSampled, numSASampled() * sizeof(uint32_t));
 
-	saIdx = BitSequenceRRR::load(in); /* use RRR implementation */
+	saIdx = BitSequence::load(in); /* either RRR or RG implementation */
 	bwt = WaveletTreeNoptrs::load(in);
 	return in;
 }
 
-CSFMIndex& CSFMIndex::build(const MSA& msa) {
-	if(!(msa.getCSLen() <= UINT16_MAX)) {
-		throw runtime_error("CSFMIndex cannot handle MSA with consensus length longer than " + UINT16_MAX);
-		return *this;
-	}
+CSFMIndex& CSFMIndex::build(const MSA& msa, uint32_t saSampleRate, SA_IDX_TYPE saIdxType) {
+	if(!(msa.getMSANonGapLen() + msa.getNumSeq() <= MAX_CONCAT_LEN))
+		throw runtime_error("CSFMIndex cannot handle MSA with more than 4G total non-gap residues");
+	if(!(saSampleRate > 0 && saSampleRate <= MAX_SA_SAMPLE_RATE))
+		throw invalid_argument("CSFMIndex SA sample rate out of range");
 	clear(); /* clear old data, if any */
+	std::fill(C, C + UINT8_MAX + 1, 0);
+	this->saSampleRate = saSampleRate;
+	this->saIdxType = saIdxType;
 
 	/* construct basic information */
 	buildBasic(msa);
@@ -249,27 +404,43 @@ CSFMIndex& CSFMIndex::build(const MSA& msa) {
 	return *this;
 }
 
-uint32_t CSFMIndex::accessSA(uint32_t i) const {
-	int32_t dist = 0;
-	while(!saIdx->access(i)) {
-		uint8_t c = bwt->access(i);
-		i = LF(i) - 1; // backward LF-mapping
-		dist++;
+double CSFMIndex::getCSIdentity(const CSLoc& loc) const {
+	assert(0 < loc.start && loc.start <= loc.end && loc.end <= csLen);
+	double sum = 0;
+	for(int j = loc.start; j <= loc.end; ++j)
+		sum += csIdentity[j];
+	return sum / (loc.end - loc.start + 1);
+}
+
+int64_t CSFMIndex::pickSA(const string& pattern, int64_t start, int64_t end) const {
+	/* FNV-1a hash of the pattern */
+	uint32_t h = 2166136261U;
+	for(string::const_iterator c = pattern.begin(); c != pattern.end(); ++c) {
+		h ^= static_cast<uint8_t>(::toupper(*c));
+		h *= 16777619U;
 	}
-	return saSampled[saIdx->rank1(i) - 1] + dist;
+	/* mix with the seed using the MurmurHash3 finalizer */
+	h ^= rngSeed;
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return start + h % (end - start + 1);
 }
 
-string CSFMIndex::extractCS(int32_t start, const string& pattern) const {
-	string csSeq;
-	if(pattern.empty())
-		return csSeq; // return empty CS
-	assert(concat2CS[start] != 0 && concat2CS[start + pattern.length() - 1] != 0);
-	for(int32_t i = start; i < start + pattern.length(); ++i) {
-		if(i > start && concat2CS[i] - concat2CS[i - 1] > 1) // there are gaps between this two location
-			csSeq.append(concat2CS[i] - concat2CS[i - 1] - 1, gapCh);
-		csSeq.push_back(pattern[i - start]);
+uint32_t CSFMIndex::accessSA(uint32_t i) const {
+	if(saSampleRate == 1) /* fully sampled SA */
+		return saSampled[i];
+	int32_t dist = 0;
+	size_t r;
+	while(!isSampled(i, r)) {
+		size_t rc;
+		uint8_t c = bwt->access(i, rc); /* get base and its rank in one pass */
+		i = C[c] + rc - 1; // backward LF-mapping
+		dist++;
 	}
-	return csSeq;
+	return saSampled[r - 1] + dist;
 }
 
 void CSFMIndex::buildBasic(const MSA& msa) {
@@ -285,12 +456,16 @@ void CSFMIndex::buildBasic(const MSA& msa) {
 }
 
 uint8_t* CSFMIndex::buildConcatSeq(const MSA& msa) {
-	const int32_t N = concatLen + 1;
+	const int64_t N = concatLen + 1;
 	/* construct the concatSeq update concat2CS index */
 	uint8_t* concatSeq = new uint8_t[N]; /* null terminated encoded string */
-	concat2CS = new uint16_t[N](); /* zero-initiate 1-based concatSeq pos to CS pos, 0 for gap pos on CS */
+	/* zero-initiate 1-based concatSeq pos to CS pos, 0 for gap pos on CS */
+	if(isWideCS())
+		concat2CSWide = new uint32_t[N]();
+	else
+		concat2CS = new uint16_t[N]();
 
-	string::size_type shift = 0;
+	int64_t shift = 0;
 	for(unsigned i = 0; i < msa.getNumSeq(); ++i) {
 		for(unsigned j = 0; j < csLen; ++j) {
 			char c = msa.residualAt(i, j);
@@ -298,13 +473,15 @@ uint8_t* CSFMIndex::buildConcatSeq(const MSA& msa) {
 				int8_t k = abc->encode(::toupper(c)) + 1; /* encode to 1..alphabet-size range */
 				C[k]++; // count alphabet frequency
 				concatSeq[shift] = k; /* always store upper-case characters */
-				concat2CS[shift] = j + 1; /* 1-based consensus position */
+				if(isWideCS())
+					concat2CSWide[shift] = j + 1; /* 1-based consensus position */
+				else
+					concat2CS[shift] = j + 1;
 				shift++;
 			}
 		}
 		C[sepCh]++; // count the separator
-		concatSeq[shift] = sepCh; // add a separator at the end of each seq
-		concat2CS[shift] = 0; // separator point to gap
+		concatSeq[shift] = sepCh; // add a separator at the end of each seq, which points to gap on CS
 		shift++;
 	}
 	assert(shift == N - 1);
@@ -312,8 +489,8 @@ uint8_t* CSFMIndex::buildConcatSeq(const MSA& msa) {
 	C['\0']++; // count the null terminal
 
 	/* construct cumulative counts */
-    int32_t prev = C[0];
-    int32_t tmp;
+    int64_t prev = C[0];
+    int64_t tmp;
     C[0] = 0;
     for (int i = 1; i <= abc->getSize() + 1; ++i) {
       tmp = C[i];
@@ -326,32 +503,47 @@ uint8_t* CSFMIndex::buildConcatSeq(const MSA& msa) {
 
 void CSFMIndex::buildBWT(const uint8_t* concatSeq) {
     /* construct SA */
-    saidx_t errn;
-    const int32_t N = concatLen + 1;
-    int32_t* SA = new int32_t[N];
-
-	errn = divsufsort(concatSeq, SA, N);
-	if(errn != 0)
-		throw runtime_error("Error: Cannot build suffix-array on forward concatenated seq");
+    const int64_t N = concatLen + 1;
+	if(is64()) { /* use 64-bit suffix-array construction */
+		saidx64_t* SA = new saidx64_t[N];
+		if(divsufsort64(concatSeq, SA, N) != 0)
+			throw runtime_error("Error: Cannot build suffix-array on forward concatenated seq");
+		buildBWT(concatSeq, SA);
+		delete[] SA;
+	}
+	else {
+		saidx_t* SA = new saidx_t[N];
+		if(divsufsort(concatSeq, SA, N) != 0)
+			throw runtime_error("Error: Cannot build suffix-array on forward concatenated seq");
+		buildBWT(concatSeq, SA);
+		delete[] SA;
+	}
+}
 
+template<typename saidx>
+void CSFMIndex::buildBWT(const uint8_t* concatSeq, const saidx* SA) {
+    const int64_t N = concatLen + 1;
     /* construct the saSampled and saIdx */
-	saSampled = new uint32_t[N / SA_SAMPLE_RATE + 1]() /* zero-initiation */;
+	saSampled = new uint32_t[numSASampled()]() /* zero-initiation */;
 	uint32_t* saHead = saSampled;
 	BitString B(N); /* a temp BitString for building saIdx */
-	for(uint32_t i = 0; i < N; ++i)
-		if(SA[i] % SA_SAMPLE_RATE == 0) {
+	for(int64_t i = 0; i < N; ++i)
+		if(SA[i] % saSampleRate == 0) {
 			*saHead++ = SA[i];
 			B.setBit(i);
 		}
-	//cerr << "shift:" << saHead - csFM->saSampled << endl;
+	assert(saHead - saSampled == numSASampled());
 
-    saIdx = new BitSequenceRRR(B, RRR_SAMPLE_RATE); /* use RRR implementation */
+	if(saIdxType == RG)
+		saIdx = new BitSequenceRG(B, RG_SAMPLE_RATE); /* use plain RG implementation */
+	else
+		saIdx = new BitSequenceRRR(B, RRR_SAMPLE_RATE); /* use RRR implementation */
 
     /* construct BWT and index */
 	uint8_t* X_bwt = new uint8_t[N];
 	if(X_bwt == NULL)
 		throw runtime_error("Error: Cannot allocate BWT string for concatSeq");
-    for(int32_t i = 0; i < N; ++i)
+    for(int64_t i = 0; i < N; ++i)
         if(SA[i] == 0) // matches to the null
             X_bwt[i] = '\0'; // null terminal
         else X_bwt[i] = concatSeq[SA[i] - 1];
@@ -362,9 +554,6 @@ void CSFMIndex::buildBWT(const uint8_t* concatSeq) {
 
     bwt = new WaveletTreeNoptrs((uint32_t *) X_bwt, N,
     		sizeof(uint8_t) * 8, bsb, map, true); // free the X_bwt after use
-
-    /* free temporary memories */
-    delete[] SA;
 }
 
 } /* namespace HmmUFOtu */
@@ -34,6 +34,7 @@
 #include "MSA.h"
 #include "CSLoc.h"
 #include "divsufsort.h"
+#include "divsufsort64.h"
 #include "WaveletTreeNoptrs.h"
 #include "BitSequence.h"
 //#include "Array.h"
@@ -50,11 +51,19 @@ using std::ostream;
  */
 class CSFMIndex {
 public:
+	/* nested enums */
+	/** index types for telling whether an SA position is sampled */
+	enum SA_IDX_TYPE {
+		RRR, /* RRR compressed bitmap, smaller but with slower access and rank */
+		RG   /* plain bitmap with a rank directory, larger but with constant time access and rank */
+	};
+
 	/* constructors */
 	/** Default constructor, zero-initiate all members */
 	CSFMIndex() : abc(NULL), gapCh('\0'), csLen(0),
-			concatLen(0), C(), csIdentity(NULL), concat2CS(NULL),
-			saSampled(NULL), saIdx(NULL), bwt(NULL) {
+			concatLen(0), saSampleRate(DEFAULT_SA_SAMPLE_RATE), saIdxType(RRR),
+			C(), csIdentity(NULL), concat2CS(NULL), concat2CSWide(NULL),
+			saSampled(NULL), saIdx(NULL), bwt(NULL), rngSeed(0) {
 	}
 
 	/** Virtual destructor */
@@ -63,25 +72,53 @@ public:
 	}
 
 	/** getters */
-	uint16_t getCSLen() const {
+	uint32_t getCSLen() const {
 		return csLen;
 	}
 
-	int32_t getConcatLen() const {
+	int64_t getConcatLen() const {
 		return concatLen;
 	}
 
+	uint32_t getSASampleRate() const {
+		return saSampleRate;
+	}
+
+	/** test whether the 64-bit suffix-array construction is used for this index */
+	bool is64() const {
+		return concatLen + 1 > INT32_MAX;
+	}
+
+	/** test whether the wide (32-bit) concatSeq to CS index is used for this index */
+	bool isWideCS() const {
+		return csLen > UINT16_MAX;
+	}
+
+	SA_IDX_TYPE getSAIdxType() const {
+		return saIdxType;
+	}
+
+	/** get the mean consensus identity of a located region */
+	double getCSIdentity(const CSLoc& loc) const;
+
+	/** set the random seed used for picking one of the multiple occurrences of a pattern */
+	void setRandomSeed(uint32_t seed) {
+		rngSeed = seed;
+	}
+
 	/**
 	 * Build an CSFMIndex from a MSA object, old data is removed
 	 * @param msa  pointer to an MSA object
+	 * @param saSampleRate  sample rate of the SA, every saSampleRate-th text position is sampled
+	 * @param saIdxType  index type used for telling whether an SA position is sampled
 	 * @return a fresh allocated CSFMIndex
 	 */
-	CSFMIndex& build(const MSA& msa);
+	CSFMIndex& build(const MSA& msa, uint32_t saSampleRate = DEFAULT_SA_SAMPLE_RATE, SA_IDX_TYPE saIdxType = RRR);
 
 	/** test whether this CSFMIndex object is fully initiated */
 	bool isInitiated() const {
 		return abc != NULL && gapCh != '\0' && csLen > 0
-				&& concatLen > 0 && C != NULL && concat2CS != NULL
+				&& concatLen > 0 && C != NULL && (concat2CS != NULL || concat2CSWide != NULL)
 				&& saSampled != NULL && saIdx != NULL && bwt != NULL;
 	}
 
@@ -94,13 +131,14 @@ public:
 
 	/**
 	 * load raw object data from input
+	 * the stream is set bad if the data was written in an incompatible format version
 	 */
 	istream& load(istream& in);
 
 	/**
 	 * load program info and raw object data from input
 	 */
-	int32_t count(const string& pattern) const;
+	int64_t count(const string& pattern) const;
 
 	/**
 	 * Locate the consensus sequence positions of given pattern
@@ -112,10 +150,20 @@ public:
 	/**
 	 * Locate the consensus sequence positions of given pattern
 	 * @param pattern  the un-coded pattern
-	 * @return  a random CS position
+	 * @return  a random CS position, determined by the pattern and the random seed only
 	 */
 	CSLoc locateOne(const string& pattern) const;
 
+	/**
+	 * Locate the consensus sequence position that most occurrences of given pattern agree on,
+	 * by checking up to maxOcc occurrences evenly spaced on the SA interval
+	 * @param pattern  the un-coded pattern
+	 * @param agreement  fraction of the checked occurrences agreeing on the returned position, 0 if not found
+	 * @param maxOcc  max # of occurrences to check
+	 * @return  the most supported CS position
+	 */
+	CSLoc locateBest(const string& pattern, double& agreement, uint32_t maxOcc = DEFAULT_MAX_OCC) const;
+
 	/**
 	 * Locate the consensus sequence positions of given pattern
 	 * @param pattern  the un-coded pattern
@@ -123,6 +171,16 @@ public:
 	 */
 	CSLoc locateFirst(const string& pattern) const;
 
+	/**
+	 * Locate the consensus sequence positions of given pattern, allowing up to maxMismatch mismatches,
+	 * by a bounded backtracking search on the FM-index
+	 * @param pattern  the un-coded pattern
+	 * @param maxMismatch  max # of mismatches allowed
+	 * @param maxStep  max # of LF-mapping steps allowed for backtracking, search is abandoned if exceeded
+	 * @return  a random CS position of the first matched SA interval, exact matches are always found first
+	 */
+	CSLoc locateOneApprox(const string& pattern, int maxMismatch, uint32_t maxStep = DEFAULT_MAX_BACKTRACK_STEP) const;
+
 	/**
 	 * Locate the index of the original sequences (0 .. (concatLen / (csLen + 1)) in the concatSeq of given pattern
 	 * @param pattern  the un-coded pattern
@@ -130,9 +188,18 @@ public:
 	 */
 	set<unsigned> locateIndex(const string& pattern) const;
 
-	static const unsigned SA_SAMPLE_RATE = 4;  /* sample rate for SA */
+	static const uint32_t DEFAULT_SA_SAMPLE_RATE = 4;  /* default sample rate for SA */
+	static const uint32_t MAX_SA_SAMPLE_RATE = 256;    /* max sample rate for SA */
 	static const unsigned RRR_SAMPLE_RATE = 8; /* RRR sample rate for BWT */
+	static const unsigned RG_SAMPLE_RATE = 4;  /* RG rank sampling factor for saIdx, 25% space overhead */
+	static const uint32_t DEFAULT_MAX_OCC = 16; /* default max # of occurrences checked by locateBest */
+	static const uint32_t MAX_OCC = 256; /* max # of occurrences checked by locateBest */
+	static const int MAX_MISMATCH = 2; /* max # of mismatches supported by approximate searches */
+	static const uint32_t DEFAULT_MAX_BACKTRACK_STEP = 2000; /* default max LF-mapping steps of approximate searches */
+	static const int64_t MAX_CONCAT_LEN = UINT32_MAX - 1; /* max concatLen, limited by the 32-bit sampled SA values and libcds */
 	static const char sepCh = '\0';
+	static const uint32_t FORMAT_MAGIC = 0x4D465343; /* "CSFM" tag written before the raw object data */
+	static const uint32_t FORMAT_VERSION = 2; /* bumped whenever the on-disk layout changes */
 
 	/* friend functions */
 	friend void swap(CSFMIndex& lhs, CSFMIndex& rhs);
@@ -148,7 +215,7 @@ private:
 	 * @param i  0-based loc on L column (BWT)
 	 * @return  1-based loc on F column
 	 */
-	uint32_t LF(int8_t c, uint32_t i) const {
+	int64_t LF(int8_t c, int64_t i) const {
 		return C[c] + bwt->rank(c, i);
 	}
 
@@ -157,10 +224,39 @@ private:
 	 * @param i  0-based loc on L column (BWT)
 	 * @return  1-based loc on F column
 	 */
-	uint32_t LF(uint32_t i) const {
+	int64_t LF(int64_t i) const {
 		return LF(bwt->access(i), i);
 	}
 
+	/**
+	 * test whether a given SA position is sampled, and get its rank among sampled positions if so
+	 * @param i  0-based loc on SA
+	 * @param r  rank of i on saIdx, only updated if i is sampled
+	 * @return  true if i is sampled
+	 */
+	bool isSampled(uint32_t i, size_t& r) const;
+
+	/**
+	 * backtracking search of the 0 .. i part of an encoded pattern from an SA interval
+	 * @param pattern  the encoded pattern in 1 .. alphabet-size, or 0 if not a valid symbol
+	 * @param i  current 0-based position on pattern, searched right-to-left
+	 * @param start  current 1-based SA start, 0 for the full range
+	 * @param end  current 1-based SA end
+	 * @param k  # of mismatches remaining
+	 * @param step  # of LF-mapping steps remaining, decreased on each step
+	 * @param hitStart  the SA start of a matched interval, only updated if found
+	 * @param hitEnd  the SA end of a matched interval, only updated if found
+	 * @return  true if a matched interval found
+	 */
+	bool backtrack(const vector<int8_t>& pattern, int32_t i, int64_t start, int64_t end, int k,
+			uint32_t& step, int64_t& hitStart, int64_t& hitEnd) const;
+
+	/**
+	 * pick an SA position from a matched SA interval,
+	 * using a hash of the pattern and the random seed so it is deterministic and thread-safe
+	 */
+	int64_t pickSA(const string& pattern, int64_t start, int64_t end) const;
+
 	/* private functions */
 	/*
 	 * Access a given SA loc, either by directly searching the stored value or the next sampled value
@@ -169,14 +265,6 @@ private:
 	 */
 	uint32_t accessSA(uint32_t i) const;
 
-	/**
-	 * Extract consensus sequence of given region at concatSeq location
-	 * @param start  start on BWT string
-	 * @param len  length of BWT string
-	 * @return the CS of this region, with gaps filled with default gap characters
-	 */
-	string extractCS(int32_t start, const string& pattern) const;
-
 	/**
 	 * build basic information
 	 */
@@ -187,32 +275,73 @@ private:
 	 */
 	uint8_t* buildConcatSeq(const MSA& msa);
 
-	/** build saSampled, saIdx and BWT from other members */
+	/** build SA using the 32-bit or 64-bit suffix-array construction as needed, then saSampled, saIdx and BWT */
 	void buildBWT(const uint8_t* concatSeq);
 
+	/** get number of sampled SA values */
+	uint32_t numSASampled() const {
+		return concatLen / saSampleRate + 1; /* text positions 0, saSampleRate, ..., concatLen */
+	}
+
+	/**
+	 * get the CS position of a concatSeq position
+	 * @param i  0-based concatSeq pos
+	 * @return  1-based CS pos, 0 for gap pos on CS
+	 */
+	uint32_t concat2CSAt(int64_t i) const {
+		return concat2CS != NULL ? concat2CS[i] : concat2CSWide[i];
+	}
+
+	/** build saSampled, saIdx and BWT from a constructed SA of either 32-bit or 64-bit */
+	template<typename saidx>
+	void buildBWT(const uint8_t* concatSeq, const saidx* SA);
+
 	const DegenAlphabet* abc;
 	char gapCh;
-	uint16_t csLen; /* consensus length */
+	uint32_t csLen; /* consensus length */
 	//uint8_t* concatSeq; /* concatenated alphabet-encoded non-Gap seq */
-	int32_t concatLen; /* total length of concatenated encoded non-gap seq, plus null separators between each individual seq */
-	int32_t C[UINT8_MAX + 1]; /* cumulative count of each alphabet frequency, with C[0] as dummy position */
+	int64_t concatLen; /* total length of concatenated encoded non-gap seq, plus null separators between each individual seq */
+	uint32_t saSampleRate; /* sample rate of text positions stored in saSampled */
+	SA_IDX_TYPE saIdxType; /* type of saIdx */
+	int64_t C[UINT8_MAX + 1]; /* cumulative count of each alphabet frequency, with C[0] as dummy position */
 
 	string csSeq; /* 1-based consensus seq with dummy position at 0 */
 	double* csIdentity; /* 1-based consensus identity index */
 
-	uint16_t* concat2CS; /* 0-based concatSeq pos to 1-based CS pos, 0 for gap pos on CS */
+	uint16_t* concat2CS; /* 0-based concatSeq pos to 1-based CS pos, 0 for gap pos on CS, used if csLen <= UINT16_MAX */
+	uint32_t* concat2CSWide; /* 0-based concatSeq pos to 1-based CS pos, 0 for gap pos on CS, used if csLen > UINT16_MAX */
 	uint32_t* saSampled; /* sampled SA of concatSeq */
 	cds_static::BitSequence* saIdx; /* 0-based bit index for telling whether this SA position is sampled */
 	cds_static::WaveletTreeNoptrs* bwt; /* Wavelet-Tree transformed BWT string for forward concatSeq */
+
+	uint32_t rngSeed; /* random seed for picking occurrences, not stored */
 };
 
+inline bool CSFMIndex::isSampled(uint32_t i, size_t& r) const {
+	if(saIdxType == RG) { /* constant access, only rank when necessary */
+		if(!saIdx->access(i))
+			return false;
+		r = saIdx->rank1(i);
+		return true;
+	}
+	else
+		return saIdx->access(i, r); /* access and rank in one pass */
+}
+
 inline void CSFMIndex::clear() {
 	//delete[] concatSeq;
 	delete[] csIdentity;
 	delete[] concat2CS;
+	delete[] concat2CSWide;
 	delete[] saSampled;
 	delete saIdx;
 	delete bwt;
+	csIdentity = NULL;
+	concat2CS = NULL;
+	concat2CSWide = NULL;
+	saSampled = NULL;
+	saIdx = NULL;
+	bwt = NULL;
 }
 
 } /* namespace HmmUFOtu */
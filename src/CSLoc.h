@@ -9,12 +9,9 @@
 #ifndef SRC_CSLOC_H_
 #define SRC_CSLOC_H_
 
-#include <string>
-
 namespace EGriceLab {
 namespace HmmUFOtu {
 
-using std::string;
 /**
  * A public class for describing a region on the consensus seq (CS)
  */
@@ -23,27 +20,28 @@ struct CSLoc {
 	/**
 	 * Default constructor, do nothing
 	 */
-	CSLoc() : start(0), end(0) {  }
+	CSLoc() : start(0), end(0), nGap(0) {  }
 
 	/**
 	 * Construct a CSLoc at given loc
 	 */
-	CSLoc(int start, int end, const string& CS = "")
-		: start(start), end(end), CS(CS)
+	CSLoc(int start, int end, int nGap = 0)
+		: start(start), end(end), nGap(nGap)
 	{  }
 
 	/** member methods */
 	bool isValid() const {
-		return start > 0 && start < end && CS.length() > end - start;
+		return start > 0 && start < end && nGap >= 0 && nGap < end - start;
 	}
 
+	/** test whether this CSLoc is valid and consistent with a located seq region from .. to */
 	bool isValid(int from, int to) const {
-		return isValid() && CS.length() > to - from;
+		return isValid() && end - start == to - from + nGap;
 	}
 
 	int start; // CS start
 	int end;   // CS end
-	string CS; // CS string
+	int nGap;  // # of CS positions between start and end not covered by the located seq, aka gaps
 };
 
 } /* namespace HmmUFOtu */
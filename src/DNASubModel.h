@@ -72,6 +72,14 @@ public:
 	 */
 	virtual Matrix4d Pr(double v) const = 0;
 
+	/**
+	 * Get the n-th derivative of the P transition matrix with respect to the branch length
+	 * @param v  branch length in the unit time
+	 * @param n  order of the derivative, at least 1
+	 * @return  d^n P(v) / dv^n
+	 */
+	virtual Matrix4d dPr(double v, int n = 1) const = 0;
+
 	/**
 	 * Get the estimated distance given the observed fraction of differences (p-distance) using this model
 	 * @param D  observed nucleotide differences between two sequences
@@ -61,6 +61,12 @@ public:
 	 */
 	virtual Matrix4d Pr(double v) const;
 
+	/**
+	 * get the n-th derivative of the Prob matrix given branch length
+	 * @override  the base class pure virtual function
+	 */
+	virtual Matrix4d dPr(double v, int n = 1) const;
+
 	/**
 	 * Get the substitution distance given the observed fraction of differences (p-distance) using this model
 	 * the actual formula is described in McGuire 1999
@@ -117,6 +123,17 @@ inline Matrix4d F81::Pr(double v) const {
 	return P;
 }
 
+inline Matrix4d F81::dPr(double v, int n) const {
+	assert(v >= 0 && n >= 1);
+	Matrix4d P;
+	double e = ::pow(-beta, n) * ::exp(-beta * v);
+	for(Matrix4d::Index i = 0; i < P.rows(); ++i)
+		for(Matrix4d::Index j = 0; j < P.cols(); ++j)
+			P(i, j) = i == j ? e - pi(j) * e : -pi(j) * e;
+
+	return P;
+}
+
 inline double F81::subDist(const Matrix4d& D, double N) const {
 	if(N == 0)
 		return 0;
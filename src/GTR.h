@@ -62,6 +62,12 @@ public:
 	 */
 	virtual Matrix4d Pr(double v) const;
 
+	/**
+	 * get the n-th derivative of the Prob matrix given branch length
+	 * @override  the base class pure virtual function
+	 */
+	virtual Matrix4d dPr(double v, int n = 1) const;
+
 	/**
 	 * Get the substitution distance given the observed fraction of differences (p-distance) using this model
 	 * The formular is discribed in the original GTR97 article
@@ -120,6 +126,11 @@ inline Matrix4d GTR::Pr(double v) const {
 	return U * (lambda * v).array().exp().matrix().asDiagonal() * U_1;
 }
 
+inline Matrix4d GTR::dPr(double v, int n) const {
+	assert(v >= 0 && n >= 1);
+	return U * (lambda.array().pow(n) * (lambda * v).array().exp()).matrix().asDiagonal() * U_1;
+}
+
 } /* namespace HmmUFOtu */
 } /* namespace EGriceLab */
 
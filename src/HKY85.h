@@ -61,6 +61,12 @@ public:
 	 */
 	virtual Matrix4d Pr(double v) const;
 
+	/**
+	 * get the n-th derivative of the Prob matrix given branch length
+	 * @override  the base class pure virtual function
+	 */
+	virtual Matrix4d dPr(double v, int n = 1) const;
+
 	/**
 	 * Get the substitution distance given the observed fraction of differences (p-distance) using this model
 	 * the actual formula is described in McGuire 1999
@@ -152,6 +158,43 @@ inline Matrix4d HKY85::Pr(double v) const {
 	return P;
 }
 
+inline Matrix4d HKY85::dPr(double v, int n) const {
+	assert(v >= 0 && n >= 1);
+	Matrix4d P;
+	double a = pi(A);
+	double c = pi(C);
+	double g = pi(G);
+	double t = pi(T);
+	double bR = (1 + (a + g) * (kappa - 1)) * beta;
+	double bY = (1 + (c + t) * (kappa - 1)) * beta;
+	/* only the exponential terms of Pr contribute to the derivatives */
+	double e = ::pow(-beta, n) * ::exp(-beta * v);
+	double eR = ::pow(-bR, n) * ::exp(-bR * v);
+	double eY = ::pow(-bY, n) * ::exp(-bY * v);
+
+	P(A, A) = (a * (c + t) * e + g * eR) / (a + g); /* self */
+	P(A, C) = -c * e;                               /* Tv */
+	P(A, G) = (g * (c + t) * e - g * eR) / (a + g); /* Ti */
+	P(A, T) = -t * e;                               /* Tv */
+
+	P(C, A) = -a * e;                               /* Tv */
+	P(C, C) = (c * (a + g) * e + t * eY) / (c + t); /* self */
+	P(C, G) = -g * e;                               /* Tv */
+	P(C, T) = (t * (a + g) * e - t * eY) / (c + t); /* Ti */
+
+	P(G, A) = (a * (c + t) * e - a * eR) / (a + g); /* Ti */
+	P(G, C) = -c * e;                               /* Tv */
+	P(G, G) = (g * (c + t) * e + a * eR) / (a + g); /* self */
+	P(G, T) = -t * e;                               /* Tv */
+
+	P(T, A) = -a * e;                               /* Tv */
+	P(T, C) = (c * (a + g) * e - c * eY) / (c + t); /* Ti */
+	P(T, G) = -g * e;                               /* Tv */
+	P(T, T) = (t * (a + g) * e + c * eY) / (c + t); /* self */
+
+	return P;
+}
+
 inline double HKY85::subDist(const Matrix4d& D, double N) const {
 	if(N == 0)
 		return 0;
@@ -39,6 +39,7 @@
 #include "DigitalSeq.h"
 #include "PrimarySeq.h"
 #include "SeqUtils.h"
+#include "PackedSeq.h"
 #include "SeqIO.h"
 #include "MSA.h"
 #include "CSLoc.h"
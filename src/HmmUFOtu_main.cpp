@@ -27,6 +27,8 @@
 #include <Eigen/Dense>
 #include <cassert>
 #include <algorithm>
+#include <queue>
+#include <functional>
 #include "HmmUFOtu_main.h"
 #include "StringUtils.h"
 
@@ -36,8 +38,52 @@ using namespace Eigen;
 namespace EGriceLab {
 namespace HmmUFOtu {
 
+/**
+ * Find the best seed in a region of a read and build its known VPath
+ * exact seeds are scored by the agreement of their occurrences on the CS position and the CS identity,
+ * and the first seed with fully agreed occurrences is used right away;
+ * seeds with up to maxMismatch mismatches are tried only if no exact seed found
+ * @param from  0-based region start
+ * @param to  0-based region end
+ * @param fromEnd  whether scan seeds from the region end
+ * @param vpath  the VPath of the best seed, only updated if found
+ * @return  true if found
+ */
+static bool findSeedPath(const BandedHMMP7& hmm, const CSFMIndex& csfm, const PrimarySeq& read,
+		int seedLen, int from, int to, bool fromEnd, int maxMismatch, BandedHMMP7::ViterbiAlignPath& vpath) {
+	const DegenAlphabet* abc = hmm.getNuclAbc();
+	const int nSeed = to - from - seedLen + 2;
+	for(int k = 0; k <= maxMismatch; ++k) {
+		double bestScore = -1;
+		for(int s = 0; s < nSeed; ++s) {
+			int seedFrom = fromEnd ? to - seedLen + 1 - s : from + s;
+			int seedTo = seedFrom + seedLen - 1;
+			PrimarySeq seed(abc, read.getId(), read.subseq(seedFrom, seedLen));
+			double agreement = 1;
+			const CSLoc& loc = k == 0 ? csfm.locateBest(seed.getSeq(), agreement) : csfm.locateOneApprox(seed.getSeq(), k);
+			if(!loc.isValid())
+				continue;
+			const BandedHMMP7::ViterbiAlignPath& path = hmm.buildAlignPath(loc, seedFrom + 1, seedTo + 1); /* seed_from and seed_to are 1-based */
+			if(!path.isValid())
+				continue;
+			if(k > 0 || agreement == 1) { /* an unambiguous seed */
+				vpath = path;
+				return true;
+			}
+			double score = agreement * csfm.getCSIdentity(loc);
+			if(score > bestScore) {
+				bestScore = score;
+				vpath = path;
+			}
+		}
+		if(bestScore >= 0)
+			return true;
+	}
+	return false;
+}
+
 BandedHMMP7::HmmAlignment alignSeq(const BandedHMMP7& hmm, const CSFMIndex& csfm, const PrimarySeq& read,
-		int seedLen, int seedRegion, BandedHMMP7::align_mode mode) {
+		int seedLen, int seedRegion, BandedHMMP7::align_mode mode, int seedMaxMismatch) {
 	const DegenAlphabet* abc = hmm.getNuclAbc();
 	const int K = hmm.getProfileSize();
 	const int L = hmm.getCSLen();
@@ -48,39 +94,14 @@ BandedHMMP7::HmmAlignment alignSeq(const BandedHMMP7& hmm, const CSFMIndex& csfm
 	BandedHMMP7::ViterbiAlignTrace seqVtrace; // construct an empty VTrace
 
 	int regionLen = seedRegion < read.length() ? seedRegion : read.length(); /* search region */
+	BandedHMMP7::ViterbiAlignPath vpath;
 	/* find seed in 5' */
-	for(int seedFrom = 0; seedFrom + seedLen - 1 < regionLen; ++seedFrom) {
-		int seedTo = seedFrom + seedLen - 1;
-		PrimarySeq seed(abc, read.getId(), read.subseq(seedFrom, seedLen));
-		const CSLoc& loc = csfm.locateOne(seed.getSeq());
-		if(loc.isValid()) /* a read seed located */ {
-//			cerr << "using 5' seed seedFrom: " << seedFrom << " seedTo: " << seedTo << endl;
-//			cerr << "Using 5' seed: " << seed.getSeq() << endl;
-//			fprintf(stderr, "start:%d end:%d from:%d to:%d  CSLen:%d CS:%s\n", loc.start, loc.end, seedFrom + 1, seedFrom + seedLen, loc.CS.length(), loc.CS.c_str());
-			const BandedHMMP7::ViterbiAlignPath& vpath = hmm.buildAlignPath(loc, seedFrom + 1, seedTo + 1);
-			if(vpath.isValid()) {
-				seqVpaths.push_back(vpath); /* seed_from and seed_to are 1-based */
-				break; /* only one 5'-seed necessary */
-			}
-		}
-	}
+	if(findSeedPath(hmm, csfm, read, seedLen, 0, regionLen - 1, false, seedMaxMismatch, vpath))
+		seqVpaths.push_back(vpath); /* only one 5'-seed necessary */
 	/* find seed in 3', if requested */
 	if(mode == BandedHMMP7::GLOBAL && (seqVpaths.empty() || read.length() >= 2 * regionLen)) {
-		for(int seedTo = read.length() - 1; seedTo - seedLen + 1 >= (int) read.length() - regionLen; --seedTo) {
-			int seedFrom = seedTo - seedLen + 1;
-			PrimarySeq seed(abc, read.getId(), read.subseq(seedFrom, seedLen));
-			const CSLoc& loc = csfm.locateOne(seed.getSeq());
-			if(loc.isValid()) { /* a read seed located */
-//				cerr << "using 3' seed seedFrom: " << seedFrom << " seedTo: " << seedTo << endl;
-//				cerr << "Using 3' seed: " << seed.getSeq() << endl;
-//				fprintf(stderr, "start:%d end:%d from:%d to:%d  CSLen:%d CS:%s\n", loc.start, loc.end, seedTo - seedLen + 2, seedTo + 1, loc.CS.length(), loc.CS.c_str());
-				const BandedHMMP7::ViterbiAlignPath& vpath = hmm.buildAlignPath(loc, seedFrom + 1, seedTo + 1);
-				if(vpath.isValid()) {
-					seqVpaths.push_back(vpath); /* seed_from and seed_to are 1-based */
-					break; /* only one 3'-seed necessary */
-				}
-			}
-		}
+		if(findSeedPath(hmm, csfm, read, seedLen, read.length() - regionLen, read.length() - 1, true, seedMaxMismatch, vpath))
+			seqVpaths.push_back(vpath); /* only one 3'-seed necessary */
 	}
 
 	/* banded HMM align */
@@ -124,37 +145,124 @@ BandedHMMP7::HmmAlignment alignSeq(const BandedHMMP7& hmm, const PrimarySeq& rea
 	return hmm.buildGlobalAlign(read, seqVscore, seqVtrace);
 }
 
-vector<PTUnrooted::PTLoc> getSeed(const PTUnrooted& ptu, const DigitalSeq& seq,
-		int start, int end, double maxDiff) {
+/**
+ * get seeds among given candidate nodes by their p-dist to the seq in region [start, end]
+ */
+static vector<PTUnrooted::PTLoc> getSeed(const PTUnrooted& ptu, const DigitalSeq& seq, const vector<long>& candidates,
+		int start, int end, double maxDiff, size_t maxNSeed) {
 	vector<PTUnrooted::PTLoc> locs; /* candidate locations */
+	locs.reserve(candidates.size());
 	/* get potential placement locations based on pDist to observed or inferred sequences */
-	for(vector<PTUnrooted::PTUNodePtr>::size_type i = 0; i < ptu.numNodes(); ++i) {
-		PTUnrooted::PTUNodePtr node = ptu.getNode(i);
-		if(node->isRoot())
-			continue;
-		double pDist = SeqUtils::pDist(node->getSeq(), seq, start, end);
-		locs.push_back(PTUnrooted::PTLoc(start, end, node->getId(), pDist));
+	if(ptu.isPacked()) {
+		const PackedSeq packed(seq);
+		for(vector<long>::const_iterator id = candidates.begin(); id != candidates.end(); ++id) {
+			double pDist = ptu.getPackedSeq(*id).pDist(packed, start, end);
+			locs.push_back(PTUnrooted::PTLoc(start, end, *id, pDist));
+		}
 	}
-	std::sort(locs.begin(), locs.end()); /* sort by p-Dist */
-	/* remove bad seed, if necessary */
+	else {
+		for(vector<long>::const_iterator id = candidates.begin(); id != candidates.end(); ++id) {
+			double pDist = SeqUtils::pDist(ptu.getNode(*id)->getSeq(), seq, start, end);
+			locs.push_back(PTUnrooted::PTLoc(start, end, *id, pDist));
+		}
+	}
+	selectSeed(locs, maxDiff, maxNSeed);
+	return locs;
+}
+
+void selectSeed(vector<PTUnrooted::PTLoc>& locs, double maxDiff, size_t maxNSeed) {
+	if(locs.empty())
+		return;
+	/* only the best maxNSeed locations are sorted by p-Dist and kept */
+	if(maxNSeed < locs.size()) {
+		std::partial_sort(locs.begin(), locs.begin() + maxNSeed, locs.end());
+		locs.erase(locs.begin() + maxNSeed, locs.end());
+	}
+	else
+		std::sort(locs.begin(), locs.end());
+	/* remove seeds worse than the best by more than maxDiff */
 	double bestDist = locs[0].dist;
-	double worstDist = locs[locs.size() - 1].dist;
-	if(worstDist < bestDist + maxDiff) { /* need filtering */
-		vector<PTUnrooted::PTLoc>::iterator goodSeed;
-		for(goodSeed = locs.begin(); goodSeed != locs.end(); ++goodSeed) {
-			if(goodSeed->dist - bestDist > maxDiff)
-				break;
+	vector<PTUnrooted::PTLoc>::iterator goodSeed;
+	for(goodSeed = locs.begin(); goodSeed != locs.end(); ++goodSeed) {
+		if(goodSeed->dist - bestDist > maxDiff)
+			break;
+	}
+	locs.erase(goodSeed, locs.end()); /* remove too bad placements */
+}
+
+/**
+ * get the p-dist between the seq of node id and a seq in region [start, end], use the packed seqs if available
+ */
+static inline double seedDist(const PTUnrooted& ptu, const DigitalSeq& seq, const PackedSeq& packed,
+		long id, int start, int end) {
+	return ptu.isPacked() ? ptu.getPackedSeq(id).pDist(packed, start, end)
+			: SeqUtils::pDist(ptu.getNode(id)->getSeq(), seq, start, end);
+}
+
+vector<PTUnrooted::PTLoc> getSeed(const PTUnrooted& ptu, const DigitalSeq& seq,
+		int start, int end, double maxDiff, size_t maxNSeed) {
+	vector<long> candidates; /* all nodes except the root */
+	candidates.reserve(ptu.numNodes());
+	for(vector<PTUnrooted::PTUNodePtr>::size_type i = 0; i < ptu.numNodes(); ++i)
+		if(!ptu.getNode(i)->isRoot())
+			candidates.push_back(i);
+	return getSeed(ptu, seq, candidates, start, end, maxDiff, maxNSeed);
+}
+
+vector<PTUnrooted::PTLoc> getSeed(const PTUnrooted& ptu, const SeedIndex& sidx, const DigitalSeq& seq,
+		int start, int end, double maxDiff, size_t maxNSeed) {
+	const size_t maxCandidate = maxNSeed < std::numeric_limits<size_t>::max() / SeedIndex::CANDIDATE_FACTOR ?
+			maxNSeed * SeedIndex::CANDIDATE_FACTOR : maxNSeed;
+	const vector<long>& candidates = sidx.getCandidates(seq, start, end, maxCandidate);
+	if(candidates.size() < maxNSeed && candidates.size() < ptu.numNodes() - 1) /* too few candidates, check all nodes */
+		return getSeed(ptu, seq, start, end, maxDiff, maxNSeed);
+	return getSeed(ptu, seq, candidates, start, end, maxDiff, maxNSeed);
+}
+
+vector<PTUnrooted::PTLoc> getSeedDescent(const PTUnrooted& ptu, const DigitalSeq& seq,
+		int start, int end, double maxDiff, size_t maxNSeed) {
+	typedef std::pair<double, long> DistId;
+	const PackedSeq packed = ptu.isPacked() ? PackedSeq(seq) : PackedSeq();
+	vector<PTUnrooted::PTLoc> locs; /* all visited locations */
+	std::priority_queue<DistId, vector<DistId>, std::greater<DistId> > frontier; /* visited nodes to be expanded, best first */
+	std::priority_queue<double> topDist; /* best maxNSeed dists visited so far, worst on top */
+	double bestDist = inf;
+
+	/* descend from the root, always expanding the best visited node */
+	vector<PTUnrooted::PTUNodePtr> children = ptu.getRoot()->getChildren();
+	for(;;) {
+		for(vector<PTUnrooted::PTUNodePtr>::const_iterator child = children.begin(); child != children.end(); ++child) {
+			long id = (*child)->getId();
+			double pDist = seedDist(ptu, seq, packed, id, start, end);
+			locs.push_back(PTUnrooted::PTLoc(start, end, id, pDist));
+			frontier.push(DistId(pDist, id));
+			bestDist = std::min(bestDist, pDist);
+			topDist.push(pDist);
+			if(topDist.size() > maxNSeed)
+				topDist.pop();
 		}
-		locs.erase(goodSeed, locs.end()); /* remove too bad placements */
+		if(frontier.empty())
+			break;
+		/* all remaining nodes are no better than the best one in the frontier */
+		const DistId best = frontier.top();
+		if(best.first - bestDist > maxDiff || (topDist.size() == maxNSeed && best.first > topDist.top()))
+			break;
+		frontier.pop();
+		children = ptu.getNode(best.second)->getChildren();
 	}
+
+	selectSeed(locs, maxDiff, maxNSeed);
 	return locs;
 }
 
 vector<PTUnrooted::PTPlacement> estimateSeq(const PTUnrooted& ptu, const DigitalSeq& seq,
 		const vector<PTUnrooted::PTLoc>& locs, const string& method) {
-	vector<PTUnrooted::PTPlacement> places;
-	for(vector<PTUnrooted::PTLoc>::const_iterator loc = locs.begin(); loc != locs.end(); ++loc)
-		places.push_back(ptu.estimateSeq(seq, *loc, method));
+	vector<PTUnrooted::PTPlacement> places(locs.size());
+	for(vector<PTUnrooted::PTLoc>::size_type i = 0; i < locs.size(); ++i) {
+#pragma omp task shared(ptu, seq, locs, method, places)
+		places[i] = ptu.estimateSeq(seq, locs[i], method);
+	}
+#pragma omp taskwait
 	return places;
 }
 
@@ -172,8 +280,11 @@ vector<PTUnrooted::PTPlacement>& filterPlacements(vector<PTUnrooted::PTPlacement
 }
 
 vector<PTUnrooted::PTPlacement>& placeSeq(const PTUnrooted& ptu, const DigitalSeq& seq, vector<PTUnrooted::PTPlacement>& places) {
-	for(vector<PTUnrooted::PTPlacement>::iterator place = places.begin(); place != places.end(); ++place)
-		ptu.placeSeq(seq, *place);
+	for(vector<PTUnrooted::PTPlacement>::size_type i = 0; i < places.size(); ++i) {
+#pragma omp task shared(ptu, seq, places)
+		ptu.placeSeq(seq, places[i]);
+	}
+#pragma omp taskwait
 	return places;
 }
 
@@ -32,6 +32,7 @@
 #include <vector>
 #include <algorithm>
 #include <cmath>
+#include <limits>
 #include <boost/unordered_set.hpp>
 #include <boost/unordered_map.hpp>
 #include "HmmUFOtu.h"
@@ -67,9 +68,13 @@ struct JPlace {
 	static const int MAX_Q = 250; /* maximum allowed Q value */
 };
 
-/** Align seq using banded HMM algorithm, returns an HmmAlignment */
+/**
+ * Align seq using banded HMM algorithm, returns an HmmAlignment
+ * seeds with up to seedMaxMismatch mismatches are searched if no exact seed found in the seed region,
+ * before falling back to the traditional HMM algorithm
+ */
 BandedHMMP7::HmmAlignment alignSeq(const BandedHMMP7& hmm, const CSFMIndex& csfm, const PrimarySeq& read,
-		int seedLen, int seedRegion, BandedHMMP7::align_mode mode);
+		int seedLen, int seedRegion, BandedHMMP7::align_mode mode, int seedMaxMismatch = 0);
 
 /** Align seq using traditional HMM algorithm, returns an HmmAlignment */
 BandedHMMP7::HmmAlignment alignSeq(const BandedHMMP7& hmm, const PrimarySeq& read);
@@ -81,12 +86,54 @@ BandedHMMP7::HmmAlignment alignSeq(const BandedHMMP7& hmm, const PrimarySeq& rea
  * @param start  0-based start
  * @param end  0-based end
  * @param maxDiff  maximum allowed p-Distance difference
+ * @param maxNSeed  maximum number of seeds, only the best ones are selected without sorting all nodes
  * @return  a vector of PTPlacement sorted by the p-dist
  */
 vector<PTUnrooted::PTLoc> getSeed(const PTUnrooted& ptu, const DigitalSeq& seq,
-		int start, int end, double maxDiff = inf);
+		int start, int end, double maxDiff = inf, size_t maxNSeed = std::numeric_limits<size_t>::max());
+
+/**
+ * Get seed placement locations by checking p-dist between a given seq and the candidate nodes retrieved from a SeedIndex,
+ * or all nodes if too few candidates are found
+ * @param ptu  PTUnrooted tree to be used
+ * @param sidx  SeedIndex of ptu
+ * @param seq  sequence to be placed
+ * @param start  0-based start
+ * @param end  0-based end
+ * @param maxDiff  maximum allowed p-Distance difference
+ * @param maxNSeed  maximum number of seeds
+ * @return  a vector of PTPlacement sorted by the p-dist
+ */
+vector<PTUnrooted::PTLoc> getSeed(const PTUnrooted& ptu, const SeedIndex& sidx, const DigitalSeq& seq,
+		int start, int end, double maxDiff = inf, size_t maxNSeed = std::numeric_limits<size_t>::max());
 
-/** Get estimated placement for a seq at given locations */
+/**
+ * Get seed placement locations by descending the tree from the root in a best-first order,
+ * only nodes no worse than the maxNSeed-th best node and within maxDiff of the best node visited so far are expanded
+ * @param ptu  PTUnrooted tree to be used, with sequences of all internal nodes inferred
+ * @param seq  sequence to be placed
+ * @param start  0-based start
+ * @param end  0-based end
+ * @param maxDiff  maximum allowed p-Distance difference
+ * @param maxNSeed  maximum number of seeds
+ * @return  a vector of PTPlacement sorted by the p-dist
+ */
+vector<PTUnrooted::PTLoc> getSeedDescent(const PTUnrooted& ptu, const DigitalSeq& seq,
+		int start, int end, double maxDiff = inf, size_t maxNSeed = std::numeric_limits<size_t>::max());
+
+/**
+ * select seeds by keeping the best maxNSeed locations sorted by p-dist,
+ * and removing locations worse than the best by more than maxDiff
+ * @param locs  candidate locations, modified in place
+ * @param maxDiff  maximum allowed p-Distance difference
+ * @param maxNSeed  maximum number of seeds
+ */
+void selectSeed(vector<PTUnrooted::PTLoc>& locs, double maxDiff, size_t maxNSeed);
+
+/**
+ * Get estimated placement for a seq at given locations,
+ * each location is estimated in its own OpenMP task, which can run in parallel if called within a parallel region
+ */
 vector<PTUnrooted::PTPlacement> estimateSeq(const PTUnrooted& ptu, const DigitalSeq& seq,
 		const vector<PTUnrooted::PTLoc>& locs, const string& method);
 
@@ -98,7 +145,10 @@ vector<PTUnrooted::PTPlacement> estimateSeq(const PTUnrooted& ptu, const Digital
  */
 vector<PTUnrooted::PTPlacement>& filterPlacements(vector<PTUnrooted::PTPlacement>& places, double maxError);
 
-/** Get accurate placement for a seq given the estimated placements */
+/**
+ * Get accurate placement for a seq given the estimated placements,
+ * each placement is evaluated in its own OpenMP task, which can run in parallel if called within a parallel region
+ */
 vector<PTUnrooted::PTPlacement>& placeSeq(const PTUnrooted& ptu, const DigitalSeq& seq,
 		vector<PTUnrooted::PTPlacement>& places);
 
@@ -34,5 +34,8 @@
 #include "DNASubModelFactory.h"
 #include "DiscreteGammaModel.h"
 #include "PhyloTreeUnrooted.h"
+#include "BranchArena.h"
+#include "LikKernel.h"
+#include "SeedIndex.h"
 
 #endif /* SRC_HMMUFOTU_PHYLO_H_ */
@@ -53,6 +53,12 @@ public:
 	 */
 	virtual Matrix4d Pr(double v) const;
 
+	/**
+	 * get the n-th derivative of the Prob matrix given branch length
+	 * @override  the base class pure virtual function
+	 */
+	virtual Matrix4d dPr(double v, int n = 1) const;
+
 	/**
 	 * Get the substitution distance given the observed fraction of differences (p-distance) using this model
 	 * @override  the base class function
@@ -100,6 +106,14 @@ inline Matrix4d JC69::Pr(double v) const {
 	return P;
 }
 
+inline Matrix4d JC69::dPr(double v, int n) const {
+	assert(v >= 0 && n >= 1);
+	double e = ::pow(-4.0 / 3, n) * ::exp(-4 * v / 3);
+	Matrix4d P = Matrix4d::Constant(-e / 4);
+	P.diagonal().setConstant(3 * e / 4);
+	return P;
+}
+
 inline double JC69::subDist(const Matrix4d& D, double N) const {
 	if(N == 0)
 		return 0;
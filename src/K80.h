@@ -60,6 +60,12 @@ public:
 	 */
 	virtual Matrix4d Pr(double v) const;
 
+	/**
+	 * get the n-th derivative of the Prob matrix given branch length
+	 * @override  the base class pure virtual function
+	 */
+	virtual Matrix4d dPr(double v, int n = 1) const;
+
 	/**
 	 * Get the substitution distance given the observed fraction of differences (p-distance) using this model
 	 * @override  the base class function
@@ -117,6 +123,18 @@ inline Matrix4d K80::Pr(double v) const {
 	return P;
 }
 
+inline Matrix4d K80::dPr(double v, int n) const {
+	assert(v >= 0 && n >= 1);
+	Matrix4d P;
+	double e = ::pow(-4 * beta, n) * ::exp(-4 * beta * v);
+	double eV = ::pow(-2 * (1 + kappa) * beta, n) * ::exp(-2 * (1 + kappa) * beta * v);
+	P.diagonal().setConstant((e + 2 * eV) / 4);
+	P(A,G) = P(G,A) = P(C,T) = P(T,C) = (e - 2 * eV) / 4;
+	P(A,C) = P(A,T) = P(C,A) = P(C,G) = P(G,C) = P(G,T) = P(T,A) = P(T,G) = -e / 4;
+
+	return P;
+}
+
 inline double K80::subDist(const Matrix4d& D, double N) const {
 	if(N == 0)
 		return 0;
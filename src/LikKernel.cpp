@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * LikKernel.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include "LikKernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIK_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace EGriceLab {
+namespace HmmUFOtu {
+
+static void transMultProdScalar(const double* P, const double* X, double* Y, long n) {
+	for(long j = 0; j < n; ++j, X += 4, Y += 4) {
+		double y[4];
+		for(int i = 0; i < 4; ++i)
+			y[i] = P[i] * X[0] + P[4 + i] * X[1] + P[8 + i] * X[2] + P[12 + i] * X[3];
+		for(int i = 0; i < 4; ++i)
+			Y[i] *= y[i];
+	}
+}
+
+#ifdef LIK_KERNEL_X86
+__attribute__((target("sse2")))
+static void transMultProdSSE2(const double* P, const double* X, double* Y, long n) {
+	/* each column of P split into two halves */
+	const __m128d p0l = _mm_loadu_pd(P), p0h = _mm_loadu_pd(P + 2);
+	const __m128d p1l = _mm_loadu_pd(P + 4), p1h = _mm_loadu_pd(P + 6);
+	const __m128d p2l = _mm_loadu_pd(P + 8), p2h = _mm_loadu_pd(P + 10);
+	const __m128d p3l = _mm_loadu_pd(P + 12), p3h = _mm_loadu_pd(P + 14);
+	for(long j = 0; j < n; ++j, X += 4, Y += 4) {
+		const __m128d x0 = _mm_set1_pd(X[0]);
+		const __m128d x1 = _mm_set1_pd(X[1]);
+		const __m128d x2 = _mm_set1_pd(X[2]);
+		const __m128d x3 = _mm_set1_pd(X[3]);
+		__m128d yl = _mm_add_pd(_mm_add_pd(_mm_mul_pd(p0l, x0), _mm_mul_pd(p1l, x1)),
+				_mm_add_pd(_mm_mul_pd(p2l, x2), _mm_mul_pd(p3l, x3)));
+		__m128d yh = _mm_add_pd(_mm_add_pd(_mm_mul_pd(p0h, x0), _mm_mul_pd(p1h, x1)),
+				_mm_add_pd(_mm_mul_pd(p2h, x2), _mm_mul_pd(p3h, x3)));
+		_mm_storeu_pd(Y, _mm_mul_pd(_mm_loadu_pd(Y), yl));
+		_mm_storeu_pd(Y + 2, _mm_mul_pd(_mm_loadu_pd(Y + 2), yh));
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void transMultProdAVX2(const double* P, const double* X, double* Y, long n) {
+	/* each column of P in one register */
+	const __m256d p0 = _mm256_loadu_pd(P);
+	const __m256d p1 = _mm256_loadu_pd(P + 4);
+	const __m256d p2 = _mm256_loadu_pd(P + 8);
+	const __m256d p3 = _mm256_loadu_pd(P + 12);
+	long j = 0;
+	for(; j + 1 < n; j += 2, X += 8, Y += 8) { /* two sites per iteration */
+		__m256d ya = _mm256_mul_pd(p0, _mm256_broadcast_sd(X));
+		__m256d yb = _mm256_mul_pd(p0, _mm256_broadcast_sd(X + 4));
+		ya = _mm256_fmadd_pd(p1, _mm256_broadcast_sd(X + 1), ya);
+		yb = _mm256_fmadd_pd(p1, _mm256_broadcast_sd(X + 5), yb);
+		ya = _mm256_fmadd_pd(p2, _mm256_broadcast_sd(X + 2), ya);
+		yb = _mm256_fmadd_pd(p2, _mm256_broadcast_sd(X + 6), yb);
+		ya = _mm256_fmadd_pd(p3, _mm256_broadcast_sd(X + 3), ya);
+		yb = _mm256_fmadd_pd(p3, _mm256_broadcast_sd(X + 7), yb);
+		_mm256_storeu_pd(Y, _mm256_mul_pd(_mm256_loadu_pd(Y), ya));
+		_mm256_storeu_pd(Y + 4, _mm256_mul_pd(_mm256_loadu_pd(Y + 4), yb));
+	}
+	if(j < n) { /* last odd site */
+		__m256d y = _mm256_mul_pd(p0, _mm256_broadcast_sd(X));
+		y = _mm256_fmadd_pd(p1, _mm256_broadcast_sd(X + 1), y);
+		y = _mm256_fmadd_pd(p2, _mm256_broadcast_sd(X + 2), y);
+		y = _mm256_fmadd_pd(p3, _mm256_broadcast_sd(X + 3), y);
+		_mm256_storeu_pd(Y, _mm256_mul_pd(_mm256_loadu_pd(Y), y));
+	}
+}
+#endif
+
+static LikKernel::SIMD_TYPE detectSIMD() {
+	if(LikKernel::isSupported(LikKernel::AVX2))
+		return LikKernel::AVX2;
+	if(LikKernel::isSupported(LikKernel::SSE2))
+		return LikKernel::SSE2;
+	return LikKernel::SCALAR;
+}
+
+bool LikKernel::isSupported(SIMD_TYPE type) {
+	switch(type) {
+#ifdef LIK_KERNEL_X86
+	case AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	case SSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2");
+#endif
+	case SCALAR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+LikKernel::TransMultProdFunc LikKernel::getTransMultProd(SIMD_TYPE type) {
+	switch(type) {
+#ifdef LIK_KERNEL_X86
+	case AVX2:
+		return transMultProdAVX2;
+	case SSE2:
+		return transMultProdSSE2;
+#endif
+	default:
+		return transMultProdScalar;
+	}
+}
+
+const LikKernel::SIMD_TYPE LikKernel::simdType = detectSIMD();
+const LikKernel::TransMultProdFunc LikKernel::transMultProdImpl = getTransMultProd(simdType);
+
+const char* LikKernel::simdName(SIMD_TYPE type) {
+	switch(type) {
+	case AVX2:
+		return "AVX2";
+	case SSE2:
+		return "SSE2";
+	default:
+		return "none";
+	}
+}
+
+} /* namespace HmmUFOtu */
+} /* namespace EGriceLab */
@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * LikKernel.h
+ *  Vectorized kernels for propagating conditional likelihoods through 4 X 4 transition matrices
+ *  All matrices are column-major with 4 rows, one column per alignment site,
+ *  so a 4 X n lik block is n * 4 contiguous doubles
+ *  The best instruction set (AVX2, SSE2 or plain C++) is selected at runtime
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#ifndef SRC_LIKKERNEL_H_
+#define SRC_LIKKERNEL_H_
+
+namespace EGriceLab {
+namespace HmmUFOtu {
+
+class LikKernel {
+public:
+	typedef void (*TransMultProdFunc)(const double* P, const double* X, double* Y, long n);
+
+	enum SIMD_TYPE { SCALAR, SSE2, AVX2 };
+
+	/**
+	 * multiply each site of Y by the transition of the same site of X, as Y[,j] = Y[,j] .* (P * X[,j])
+	 * @param P  4 X 4 transition matrix
+	 * @param X  4 X n input lik block
+	 * @param Y  4 X n output lik block, updated in place
+	 * @param n  number of sites
+	 */
+	static void transMultProd(const double* P, const double* X, double* Y, long n) {
+		transMultProdImpl(P, X, Y, n);
+	}
+
+	/**
+	 * get the name of the instruction set in use
+	 */
+	static const char* simdName() {
+		return simdName(simdType);
+	}
+
+	/**
+	 * get the name of a given instruction set
+	 */
+	static const char* simdName(SIMD_TYPE type);
+
+	/**
+	 * test whether a given instruction set is available on this build and CPU
+	 */
+	static bool isSupported(SIMD_TYPE type);
+
+	/**
+	 * get the transMultProd implementation of a given instruction set, which must be supported
+	 */
+	static TransMultProdFunc getTransMultProd(SIMD_TYPE type);
+
+private:
+	static const SIMD_TYPE simdType; /* best instruction set detected at runtime */
+	static const TransMultProdFunc transMultProdImpl; /* implementation selected at runtime */
+};
+
+} /* namespace HmmUFOtu */
+} /* namespace EGriceLab */
+
+#endif /* SRC_LIKKERNEL_H_ */
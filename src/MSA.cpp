@@ -137,6 +137,70 @@ MSA& MSA::prune() {
 	return *this;
 }
 
+MSA& MSA::slice(unsigned start, unsigned end) {
+	assert(start <= end && end < csLen);
+	const unsigned len = end - start + 1;
+	if(len == csLen) /* nothing to do */
+		return *this;
+
+	/* construct the sliced concatMSA */
+	string slicedMSA;
+	slicedMSA.reserve(static_cast<string::size_type> (numSeq) * len);
+	for(unsigned i = 0; i < numSeq; ++i)
+		slicedMSA.append(concatMSA, static_cast<string::size_type> (i) * csLen + start, len);
+	/* swap the storage */
+	concatMSA.swap(slicedMSA);
+
+	/* slice the known CS, if exist */
+	if(!CS.empty())
+		CS = CS.substr(start, len);
+
+	/* update index */
+	csLen = len;
+
+	/* destroy old counts */
+	clear();
+	resetRawCount();
+	resetSeqWeight();
+	resetWeightedCount();
+
+	/* rebuild the counts */
+	updateRawCounts();
+	updateSeqWeight();
+	updateWeightedCounts();
+
+	return *this;
+}
+
+MSA& MSA::append(const vector<PrimarySeq>& seqs) {
+	if(seqs.empty()) /* nothing to do */
+		return *this;
+
+	/* append to the concatMSA */
+	concatMSA.reserve(concatMSA.length() + seqs.size() * csLen);
+	for(vector<PrimarySeq>::const_iterator seq = seqs.begin(); seq != seqs.end(); ++seq) {
+		assert(seq->length() == csLen);
+		seqNames.push_back(seq->getId());
+		concatMSA.append(seq->getSeq());
+	}
+
+	/* update index */
+	numSeq += seqs.size();
+
+	/* destroy old counts */
+	clear();
+	resetRawCount();
+	resetSeqWeight();
+	resetWeightedCount();
+
+	/* rebuild the counts */
+	updateRawCounts();
+	updateSeqWeight();
+	updateWeightedCounts();
+
+	return *this;
+}
+
 long MSA::loadMSAFasta(const DegenAlphabet* abc, istream& in) {
 	SeqIO seqI(&in, abc, "fasta");
 	while(seqI.hasNext()) {
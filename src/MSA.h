@@ -128,6 +128,22 @@ public:
 	 */
 	MSA& prune();
 
+	/**
+	 * Slice this MSA to keep only the sites in the CS region [start, end], all sequences are kept
+	 * @param start  0-based start on CS
+	 * @param end  0-based end on CS
+	 * @return the modified MSA object
+	 */
+	MSA& slice(unsigned start, unsigned end);
+
+	/**
+	 * Append aligned sequences to this MSA, with all counts and seq weights updated,
+	 * while the known CS is kept as is so CS positions are not changed
+	 * @param seqs  aligned sequences with the same length as the CS
+	 * @return the modified MSA object
+	 */
+	MSA& append(const vector<PrimarySeq>& seqs);
+
 	/**
 	 * get the total length of this MSA
 	 * @return the total MSA length w/ gaps
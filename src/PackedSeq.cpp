@@ -0,0 +1,113 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * PackedSeq.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include "PackedSeq.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PACKED_SEQ_X86 1
+#endif
+
+namespace EGriceLab {
+namespace HmmUFOtu {
+
+PackedSeq::PackedSeq(const DigitalSeq& seq) : len(seq.length()),
+		words(3 * ((seq.length() + WORD_BITS - 1) / WORD_BITS), 0) {
+	for(int i = 0; i < len; ++i) {
+		int b = seq[i];
+		if(b < 0) /* gap */
+			continue;
+		word_t* w = &words[3 * (i / WORD_BITS)];
+		const word_t bit = static_cast<word_t>(1) << (i % WORD_BITS);
+		if(b & 1)
+			w[0] |= bit;
+		if(b & 2)
+			w[1] |= bit;
+		w[2] |= bit;
+	}
+}
+
+/**
+ * count the differences and the shared non-gap sites of two packed seqs in [start, end]
+ * inlined into each implementation so its popcount compiles to the target instruction
+ */
+static inline double pDistWords(const PackedSeq::word_t* seq1, const PackedSeq::word_t* seq2, int start, int end) {
+	const int WORD_BITS = PackedSeq::WORD_BITS;
+	const int first = start / WORD_BITS;
+	const int last = end / WORD_BITS;
+	long d = 0;
+	long N = 0;
+	for(int k = first; k <= last; ++k) {
+		const PackedSeq::word_t* w1 = seq1 + 3 * k;
+		const PackedSeq::word_t* w2 = seq2 + 3 * k;
+		PackedSeq::word_t mask = w1[2] & w2[2];
+		if(k == first)
+			mask &= ~static_cast<PackedSeq::word_t>(0) << (start % WORD_BITS);
+		if(k == last && end % WORD_BITS != WORD_BITS - 1)
+			mask &= (static_cast<PackedSeq::word_t>(1) << (end % WORD_BITS + 1)) - 1;
+		d += __builtin_popcountll(((w1[0] ^ w2[0]) | (w1[1] ^ w2[1])) & mask);
+		N += __builtin_popcountll(mask);
+	}
+	return static_cast<double>(d) / N;
+}
+
+static double pDistGeneric(const PackedSeq::word_t* seq1, const PackedSeq::word_t* seq2, int start, int end) {
+	return pDistWords(seq1, seq2, start, end);
+}
+
+#ifdef PACKED_SEQ_X86
+__attribute__((target("popcnt")))
+static double pDistPOPCNT(const PackedSeq::word_t* seq1, const PackedSeq::word_t* seq2, int start, int end) {
+	return pDistWords(seq1, seq2, start, end);
+}
+#endif
+
+static bool hasPOPCNT() {
+#ifdef PACKED_SEQ_X86
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("popcnt");
+#else
+	return false;
+#endif
+}
+
+static const bool usePOPCNT = hasPOPCNT();
+
+static PackedSeq::PDistFunc selectPDist(bool popcnt) {
+#ifdef PACKED_SEQ_X86
+	if(popcnt)
+		return pDistPOPCNT;
+#endif
+	return pDistGeneric;
+}
+
+const PackedSeq::PDistFunc PackedSeq::pDistImpl = selectPDist(usePOPCNT);
+
+const char* PackedSeq::popcountName() {
+	return usePOPCNT ? "POPCNT" : "generic";
+}
+
+} /* namespace HmmUFOtu */
+} /* namespace EGriceLab */
@@ -0,0 +1,94 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * PackedSeq.h
+ *  A 2-bit packed DNA sequence with a mask of non-gap sites, for bit-parallel p-distance calculation
+ *  Every 64 sites are stored in three words, as the low bits, the high bits and the mask of their bases
+ *  The popcount instruction is used if supported at runtime
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#ifndef SRC_PACKEDSEQ_H_
+#define SRC_PACKEDSEQ_H_
+
+#include <vector>
+#include <cassert>
+#include <stdint.h>
+#include "DigitalSeq.h"
+
+namespace EGriceLab {
+namespace HmmUFOtu {
+
+using std::vector;
+
+class PackedSeq {
+public:
+	typedef uint64_t word_t;
+	typedef double (*PDistFunc)(const word_t* seq1, const word_t* seq2, int start, int end);
+
+	/** default constructor */
+	PackedSeq() : len(0) { }
+
+	/**
+	 * construct a PackedSeq from a DigitalSeq of a 4-letter alphabet
+	 * any negative base is treated as a gap
+	 */
+	explicit PackedSeq(const DigitalSeq& seq);
+
+	/** get the length of this seq */
+	int length() const {
+		return len;
+	}
+
+	/**
+	 * get the p-dist to another PackedSeq of the same length in region [start, end],
+	 * which gives the same value as SeqUtils::pDist() of the original DigitalSeqs
+	 */
+	double pDist(const PackedSeq& other, int start, int end) const {
+		assert(len == other.len);
+		return pDistImpl(&words[0], &other.words[0], start, end);
+	}
+
+	/**
+	 * get the p-dist to another PackedSeq of the same length in the whole region
+	 */
+	double pDist(const PackedSeq& other) const {
+		return pDist(other, 0, len - 1);
+	}
+
+	/**
+	 * get the name of the popcount implementation in use
+	 */
+	static const char* popcountName();
+
+	static const int WORD_BITS = 64;
+
+private:
+	int len;
+	vector<word_t> words; /* low bits, high bits and mask of every 64 sites */
+
+	static const PDistFunc pDistImpl; /* implementation selected at runtime */
+};
+
+} /* namespace HmmUFOtu */
+} /* namespace EGriceLab */
+
+#endif /* SRC_PACKEDSEQ_H_ */
@@ -46,6 +46,7 @@
 #include "SeqUtils.h"
 #include "PhyloTreeUnrooted.h"
 #include "DNASubModelFactory.h"
+#include "LikKernel.h"
 
 namespace EGriceLab {
 namespace HmmUFOtu {
@@ -54,6 +55,8 @@ using namespace std;
 using namespace EGriceLab;
 using Eigen::Map;
 using Eigen::Matrix4Xd;
+using Eigen::Matrix4Xf;
+using Eigen::VectorXd;
 
 const string PTUnrooted::PTPlacement::UNASSIGNED_TAXONNAME = "UNASSIGNED";
 const double PTUnrooted::PTPlacement::UNASSIGNED_LOGLIK = nan;
@@ -64,7 +67,10 @@ const double PTUnrooted::PTPlacement::UNASSIGNED_RATIO = nan;
 const string PTUnrooted::PTPlacement::TSV_HEADER = "branch_id\tbranch_ratio\ttaxon_id\ttaxon_anno\tanno_dist\tloglik\tQ_placement\tQ_taxon";
 
 const double PhyloTreeUnrooted::MIN_LOGLIK_EXP = DBL_MIN_EXP / 2; /* use half of the DBL_MIN_EXP to avoid numeric-underflow */
-const double PhyloTreeUnrooted::INVALID_LOGLIK = 1;
+const double PhyloTreeUnrooted::INVALID_LIK = -1;
+const double PhyloTreeUnrooted::MIN_LIK = ::ldexp(1.0, -LIK_SCALE_EXP);
+const double PhyloTreeUnrooted::LIK_SCALE = ::ldexp(1.0, LIK_SCALE_EXP);
+const double PhyloTreeUnrooted::LOG_LIK_SCALE = LIK_SCALE_EXP * M_LN2;
 const double PhyloTreeUnrooted::LOGLIK_REL_EPS = 1e-6;
 const double PhyloTreeUnrooted::BRANCH_EPS = 1e-5;
 
@@ -82,6 +88,8 @@ const string PhyloTreeUnrooted::DEFAULT_ROOT_NAME = "cellular_organisms";
 const Matrix4d PhyloTreeUnrooted::leafMat = initLeafMat();
 const PTUnrooted::DGammaPtr PhyloTreeUnrooted::nulldG;
 const PTUnrooted::PTUNodePtr PhyloTreeUnrooted::nullNode;
+const uint32_t PhyloTreeUnrooted::FORMAT_MAGIC;
+const uint32_t PhyloTreeUnrooted::FORMAT_VERSION;
 
 static const char* TAXON_SEP = ";: "; /* valid taxon name separator */
 
@@ -126,7 +134,7 @@ ostream& PhyloTreeUnrooted::PhyloTreeUnrootedNode::save(ostream& out) const {
 	return out;
 }
 
-PhyloTreeUnrooted::PhyloTreeUnrooted(const NewickTree& ntree) : csLen(0) {
+PhyloTreeUnrooted::PhyloTreeUnrooted(const NewickTree& ntree) : csLen(0), numPattern(0), branchLength(1), singlePrec(false), quantized(false), rootLoglikId(-1) {
 	/* construct PTUNode by DFS of the NewickTree */
 	boost::unordered_set<const NT*> visited;
 	stack<const NT*> S;
@@ -215,9 +223,174 @@ unsigned PhyloTreeUnrooted::loadMSA(const MSA& msa) {
 		node2msaId[*node] = result->second;
 	}
 	assert(msaId2node.size() == node2msaId.size());
+	initSitePatterns();
 	return msaId2node.size() - n0;
 }
 
+void PTUnrooted::initSitePatterns() {
+	/* collect the column of every aligned site over all leaf sequences, gaps and ambiguous bases are treated the same */
+	vector<string> siteCols(csLen);
+	for(vector<PTUNodePtr>::const_iterator node = id2node.begin(); node != id2node.end(); ++node) {
+		if(!((*node)->isLeaf() && (*node)->seq.length() == csLen))
+			continue;
+		for(int j = 0; j < csLen; ++j)
+			siteCols[j].push_back((*node)->seq[j] >= 0 ? (*node)->seq[j] : -1);
+	}
+
+	/* assign site patterns in the order of their first occurrence */
+	unordered_map<string, int> col2pattern;
+	site2pattern.resize(csLen);
+	pattern2site.clear();
+	patternWeight.clear();
+	for(int j = 0; j < csLen; ++j) {
+		unordered_map<string, int>::const_iterator result = col2pattern.find(siteCols[j]);
+		if(result == col2pattern.end()) { /* a new pattern */
+			site2pattern[j] = col2pattern[siteCols[j]] = pattern2site.size();
+			pattern2site.push_back(j);
+			patternWeight.push_back(1);
+		}
+		else {
+			site2pattern[j] = result->second;
+			patternWeight[result->second]++;
+		}
+	}
+	numPattern = pattern2site.size();
+}
+
+void PTUnrooted::slice(int start, int end) {
+	assert(0 <= start && start <= end && end < csLen);
+	const int L = end - start + 1;
+	if(L == csLen) /* nothing to do */
+		return;
+
+	/* slice the seq of every node */
+	for(vector<PTUNodePtr>::const_iterator node = id2node.begin(); node != id2node.end(); ++node) {
+		DigitalSeq& seq = (*node)->seq;
+		if(seq.length() != csLen) /* no seq on this node */
+			continue;
+		seq.erase(end + 1);
+		seq.erase(0, start);
+	}
+	if(isPacked())
+		packSeqs();
+
+	/* re-compress the remaining sites, identical sites share a pattern both before and after slicing */
+	recompressSitePatterns(start, L);
+}
+
+void PTUnrooted::recompressSitePatterns(int start, int L) {
+	const vector<int> oldSite2pattern(site2pattern);
+	const int oldNumPattern = numPattern;
+	csLen = L;
+	initSitePatterns();
+
+	/* gather the cached lik of the new patterns of every branch */
+	const long nBranch = branchLength.size();
+	Matrix4Xd lik(4, nBranch * numPattern);
+	RowVectorXi scale(nBranch * numPattern);
+	for(long i = 0; i < nBranch; ++i) {
+		for(int p = 0; p < numPattern; ++p) {
+			long k = i * oldNumPattern + oldSite2pattern[start + pattern2site[p]];
+			lik.col(i * numPattern + p) = likAt(k);
+			scale(i * numPattern + p) = arena.scale(k);
+		}
+	}
+
+	/* rebuild the branch arena in the same precision */
+	arena = BranchArena();
+	arena.setSinglePrec(singlePrec);
+	growBranchArena(nBranch * numPattern);
+	setLikBlock(0, lik);
+	arena.scale = scale;
+}
+
+PTUnrooted::PTUNodePtr PTUnrooted::graftSeq(const DigitalSeq& seq, unsigned msaId,
+		const PTUNodePtr& u, const PTUNodePtr& v, double ratio, double wnr) {
+	assert(seq.length() == csLen); /* make sure this is an aligned seq */
+	assert(isParent(v, u));
+	assert(0 <= ratio && ratio <= 1);
+
+	double w0 = getBranchLength(u, v);
+	/* create a new interior node and a new leaf with given seq */
+	PTUNodePtr r(new PTUNode(numNodes(), ""));
+	PTUNodePtr n(new PTUNode(numNodes() + 1, seq.getName(), seq));
+	id2node.push_back(r);
+	id2node.push_back(n);
+
+	/* re-link u and v to r, so u->r and v->r keep the branches of u->v and v->u */
+	*std::find(u->neighbors.begin(), u->neighbors.end(), v) = r;
+	*std::find(v->neighbors.begin(), v->neighbors.end(), u) = r;
+	r->neighbors.push_back(u);
+	r->branches.push_back(newBranch());
+	r->neighbors.push_back(v);
+	r->branches.push_back(newBranch());
+	addEdge(n, r);
+	setBranchLength(u, r, w0 * ratio);
+	setBranchLength(v, r, w0 * (1 - ratio));
+	setBranchLength(n, r, wnr);
+	n->parent = r;
+	r->parent = v;
+	u->parent = r; /* last, as v might refer to u->parent */
+
+	/* update index */
+	msaId2node[msaId] = n;
+	node2msaId[n] = msaId;
+
+	/* update node heights of r and its ancestors */
+	node2height[n] = 0;
+	double h = std::min(getHeight(u) + w0 * ratio, wnr);
+	node2height[r] = h;
+	for(PTUNodePtr node = r; !node->isRoot(); node = node->parent) {
+		h += getBranchLength(node, node->parent);
+		if(h >= getHeight(node->parent))
+			break;
+		node2height[node->parent] = h;
+	}
+
+	return n;
+}
+
+long PTUnrooted::evaluateGrafted(const vector<PTUNodePtr>& leaves) {
+	/* the grafted leaves only split the old site patterns */
+	recompressSitePatterns(0, csLen);
+
+	/* count the grafted leaves in the subtree of every node */
+	boost::unordered_map<PTUNodePtr, size_t> node2grafted;
+	for(vector<PTUNodePtr>::const_iterator leaf = leaves.begin(); leaf != leaves.end(); ++leaf)
+		for(PTUNodePtr node = *leaf; node != nullNode; node = node->parent)
+			node2grafted[node]++;
+
+	/* reset the branches in either direction with a grafted leaf behind them, all other branches are kept */
+	long nBranch = 0;
+	for(vector<PTUNodePtr>::const_iterator node = id2node.begin(); node != id2node.end(); ++node) {
+		if((*node)->isRoot())
+			continue;
+		const PTUNodePtr& parent = (*node)->parent;
+		boost::unordered_map<PTUNodePtr, size_t>::const_iterator result = node2grafted.find(*node);
+		size_t nGrafted = result != node2grafted.end() ? result->second : 0;
+		if(nGrafted > 0) /* behind node->parent */
+			resetLoglik(*node, parent);
+		if(nGrafted < leaves.size()) /* behind parent->node */
+			resetLoglik(parent, *node);
+		nBranch += !isEvaluated(*node, parent) + !isEvaluated(parent, *node);
+	}
+
+	/* evaluate the reset branches only */
+	resetRootLoglik();
+	evaluateAll();
+	updateRootLoglik();
+
+	/* re-infer the seq of all interior nodes */
+	for(vector<PTUNodePtr>::const_iterator node = id2node.begin(); node != id2node.end(); ++node)
+		if(!(*node)->isLeaf())
+			(*node)->seq.clear();
+	inferSeq();
+	if(!id2packed.empty())
+		packSeqs();
+
+	return nBranch;
+}
+
 istream& PTUnrooted::loadAnnotation(istream& in) {
 	string line, name, anno;
 	unordered_map<string, string> name2anno;
@@ -284,81 +457,249 @@ void PhyloTreeUnrooted::calcNodeHeight() {
 	}
 }
 
-void PTUnrooted::updateRootLoglik() {
-	for(int j = 0; j < csLen; ++j)
-		node2branch[root][nullNode].loglik.col(j) = loglik(root, j);
+void PTUnrooted::updateRootLoglik(int start, int end) {
+	patternRange(start, end);
+	calcBranchLik(root, claimBranch(root, nullNode), start, end);
 }
 
 void PhyloTreeUnrooted::resetBranchLoglik() {
-	for(vector<PTUNodePtr>::iterator u = id2node.begin(); u != id2node.end(); ++u)
-		for(vector<PTUNodePtr>::iterator v = (*u)->neighbors.begin(); v != (*u)->neighbors.end(); ++v)
-			node2branch[*u][*v].loglik.setConstant(INVALID_LOGLIK);
+	/* all branches except the root branch */
+	long nCol = arena.cols();
+	invalidateLik((ROOT_BRANCH + 1) * numPattern, nCol - (ROOT_BRANCH + 1) * numPattern);
+}
+
+void PTUnrooted::setSinglePrec(bool flag) {
+	if(flag == singlePrec)
+		return;
+	arena.setSinglePrec(flag);
+	singlePrec = flag;
+}
+
+void PTUnrooted::setQuantized(bool flag) {
+	if(flag)
+		setSinglePrec(true);
+	quantized = flag;
 }
 
 void PhyloTreeUnrooted::initBranchLoglik() {
-	for(vector<PTUNodePtr>::iterator u = id2node.begin(); u != id2node.end(); ++u)
-		for(vector<PTUNodePtr>::iterator v = (*u)->neighbors.begin(); v != (*u)->neighbors.end(); ++v) /* u->neighbors */
-			node2branch[*u][*v].loglik = Matrix4Xd::Constant(4, csLen, INVALID_LOGLIK);
+	initBranchArena();
+	resetBranchLoglik();
 }
 
-Vector4d PhyloTreeUnrooted::loglikConv(const PTUNodePtr& node, int j, double r) const {
+long PTUnrooted::newBranch() {
+	long i = branchLength.size();
+	branchLength.push_back(0);
+	branchPr.resize(branchLength.size() * numRates() * 16);
+	updateBranchPr(i);
+	growBranchArena((i + 1) * numPattern);
+	return i;
+}
+
+void PTUnrooted::initBranchArena() {
+	growBranchArena(branchLength.size() * numPattern);
+}
+
+void PTUnrooted::growBranchArena(long nCol) {
+	arena.grow(nCol, INVALID_LIK);
+}
+
+void PTUnrooted::updateBranchPr(long i) {
+	if(model == NULL)
+		return;
+	const int K = numRates();
+	for(int k = 0; k < K; ++k) {
+		Map<Matrix4d> P(&branchPr[(i * K + k) * 16]);
+		P = model->Pr(dG == nulldG ? branchLength[i] : branchLength[i] * dG->rate(k));
+	}
+}
+
+void PTUnrooted::updateBranchPr() {
+	branchPr.resize(branchLength.size() * numRates() * 16);
+	for(vector<double>::size_type i = 0; i < branchLength.size(); ++i)
+		updateBranchPr(i);
+}
+
+Vector4d PhyloTreeUnrooted::likConv(const PTUNodePtr& node, int j, double r) const {
 	assert(isEvaluated(node, node->parent, j));
-	return dot_product_scaled(model->Pr(getBranchLength(node, node->parent) * r), getBranchLoglik(node, node->parent, j));
+	long i = getBranchIndex(node, node->parent);
+	return model->Pr(branchLength[i] * r) * likAt(likIndex(i, j));
 }
 
-Vector4d PhyloTreeUnrooted::loglik(const PTUNodePtr& node, int j) const {
-	if(isEvaluated(node, node->parent, j))
-		return getBranchLoglik(node, node->parent, j);
+Vector4d PhyloTreeUnrooted::lik(const PTUNodePtr& node, int j, int& scale) const {
+	long i = findBranch(node, node->parent);
+	if(i >= 0 && isLikValid(likIndex(i, j), 1)) { /* already evaluated */
+		scale = arena.scale(likIndex(i, j));
+		return likAt(likIndex(i, j));
+	}
 
-	Vector4d loglikVec = Vector4d::Zero();
-	Matrix4Xd loglikMat;
-	if(dG != nulldG)
-		loglikMat = Matrix4Xd::Zero(4, dG->getK());
+	Vector4d likVec;
+	calcLik(node, site2pattern[j], site2pattern[j], likVec.data(), &scale);
+	return likVec;
+}
 
+void PTUnrooted::calcLik(const PTUNodePtr& node, const PTUNodePtr& to, int start, int end, double* lik, int* scale) const {
+	const int L = end - start + 1;
+	const int K = numRates();
+	Map<Matrix4Xd> likMap(lik, 4, L);
+	Map<RowVectorXi> scaleMap(scale, L);
+
+	Matrix4Xd likMat = Matrix4Xd::Ones(4, K * L); /* lik of each rate category */
+	Matrix4Xd buf; /* child lik converted from a single precision arena */
+	scaleMap.setZero();
 	for(vector<PTUNodePtr>::const_iterator child = node->neighbors.begin(); child != node->neighbors.end(); ++child) {
-		if(isChild(*child, node)) {
-			if(dG == nulldG) // fixed rate
-				loglikVec += loglikConv(*child, j); // using fixed rate
-			else { /* use Gamma model */
-				for(int k = 0; k < dG->getK(); ++k)
-					loglikMat.col(k) += loglikConv(*child, j, dG->rate(k));
-			}
+		if(*child != to) {
+			long i = getBranchIndex(*child, node);
+			multLik(getBranchPr(i, 0).data(), likBlock(i * numPattern + start, L, buf),
+					arena.scale.data() + i * numPattern + start, likMat, K, scale);
 		}
 	}
 
-	if(!node->isLeaf() && dG != nulldG)
-		loglikVec = row_mean_exp_scaled(loglikMat); // use average of DiscreteGammaModel rate
-	if(node->isLeaf() && !node->seq.empty())
-		loglikVec += getLeafLoglik(node->seq, j);
+	if(node->isLeaf() && !node->seq.empty()) {
+		Matrix4Xd leafLik(4, L);
+		for(int j = 0; j < L; ++j)
+			leafLik.col(j) = getLeafLik(node->seq, pattern2site[start + j]);
+		multLeafLik(leafLik, likMat, K, scale);
+	}
 
-	return loglikVec;
+	/* use average of DiscreteGammaModel rate */
+	avgLik(likMat, K, lik);
 }
 
-Matrix4Xd PTUnrooted::loglik(const PTUNodePtr& node) const {
-	if(isEvaluated(node, node->parent)) /* already evaluated */
-		return getBranchLoglik(node, node->parent);
+void PTUnrooted::calcTransPr(double w, Matrix4Xd& P) const {
+	const int K = numRates();
+	P.resize(4, 4 * K);
+	for(int k = 0; k < K; ++k)
+		P.middleCols<4>(4 * k) = model->Pr(dG == nulldG ? w : w * dG->rate(k));
+}
+
+void PTUnrooted::multLik(const double* P, const double* X, const int* XS, Matrix4Xd& lik, int K, int* scale) {
+	const Matrix4Xd::Index L = lik.cols() / K;
+	for(int k = 0; k < K; ++k)
+		LikKernel::transMultProd(P + 16 * k, X, lik.col(k * L).data(), L);
+	for(Matrix4Xd::Index j = 0; j < L; ++j)
+		scale[j] += XS[j];
+	rescaleLik(lik, K, scale);
+}
+
+void PTUnrooted::multLeafLik(const Matrix4Xd& leafLik, Matrix4Xd& lik, int K, int* scale) {
+	const Matrix4Xd::Index L = leafLik.cols();
+	for(int k = 0; k < K; ++k)
+		lik.middleCols(k * L, L) = lik.middleCols(k * L, L).cwiseProduct(leafLik);
+	rescaleLik(lik, K, scale);
+}
 
+void PTUnrooted::avgLik(const Matrix4Xd& likMat, int K, double* lik) {
+	const Matrix4Xd::Index L = likMat.cols() / K;
+	Map<Matrix4Xd> likMap(lik, 4, L);
+	likMap = likMat.leftCols(L);
+	for(int k = 1; k < K; ++k)
+		likMap += likMat.middleCols(k * L, L);
+	if(K > 1)
+		likMap /= K;
+}
+
+Matrix4Xd PTUnrooted::loglik(const PTUNodePtr& node) const {
 	Matrix4Xd loglikMat(4, csLen);
 	for(int j = 0; j < csLen; ++j)
 		loglikMat.col(j) = loglik(node, j);
 	return loglikMat;
 }
 
+Matrix4Xd PTUnrooted::getBranchLoglik(const PTUNodePtr& u, const PTUNodePtr& v) const {
+	long i = getBranchIndex(u, v);
+	Matrix4Xd loglikMat(4, csLen);
+	for(int j = 0; j < csLen; ++j)
+		loglikMat.col(j) = lik2loglik(likAt(likIndex(i, j)), arena.scale(likIndex(i, j)));
+	return loglikMat;
+}
+
 void PTUnrooted::evaluate(const PTUNodePtr& node, int start, int end) {
-	if(isEvaluated(node, node->parent, start, end)) /* already evaluated */
+	patternRange(start, end);
+#ifdef _OPENMP
+	if(!omp_in_parallel()) { /* start a new team to run the evaluation tasks */
+#pragma omp parallel
+#pragma omp single
+		evaluatePatterns(node, start, end);
+		return;
+	}
+#endif
+	/* evaluation tasks join the enclosing team */
+	evaluatePatterns(node, start, end);
+}
+
+void PTUnrooted::evaluatePatterns(const PTUNodePtr& node, int start, int end) {
+	long i0 = findBranch(node, node->parent);
+	if(i0 >= 0 && isLikValid(i0 * numPattern + start, end - start + 1)) /* already evaluated */
 		return;
 
-	/* evaluate each child recursively */
+	/* evaluate each child recursively, independent subtrees are evaluated in parallel tasks */
 	for(vector<PTUNodePtr>::const_iterator child = node->neighbors.begin(); child != node->neighbors.end(); ++child) { /* check each child */
-		if(isChild(*child, node)) /* a child neighbor */
-			evaluate(*child, start, end); /* evaluate child recursively */
+		if(isChild(*child, node)) { /* a child neighbor */
+#pragma omp task
+			evaluatePatterns(*child, start, end); /* evaluate child recursively */
+		}
 	}
+#pragma omp taskwait
 	/* evaluating either a leaf node or a node with all children evaluated */
 	/* cache loglik if it is not the root */
 	if(!node->isRoot()) {
-#pragma omp parallel for
-		for(int j = start; j <= end; ++j)
-			node2branch[node][node->parent].loglik.col(j) = loglik(node, j);
+		const long i = getBranchIndex(node, node->parent);
+		/* each block of patterns is evaluated in its own task, if there are multiple blocks */
+		for(int b = start; b <= end; b += LIK_BLOCK_SIZE) {
+#pragma omp task if(end - start + 1 > LIK_BLOCK_SIZE)
+			calcBranchLik(node, i, b, std::min(b + LIK_BLOCK_SIZE - 1, end));
+		}
+#pragma omp taskwait
+	}
+}
+
+void PTUnrooted::evaluateAll() {
+	/* first pass in postorder, evaluate all branches towards the root */
+	evaluate();
+	/* second pass in preorder, evaluate all branches away from the root */
+#ifdef _OPENMP
+	if(!omp_in_parallel()) { /* start a new team to run the evaluation tasks */
+#pragma omp parallel
+#pragma omp single
+		evaluateOutward(root);
+		return;
+	}
+#endif
+	evaluateOutward(root);
+}
+
+void PTUnrooted::evaluateOutward(const PTUNodePtr& node) {
+	/* evaluate branches from this node towards each child, using the evaluated branches of all other neighbors */
+	for(vector<PTUNodePtr>::const_iterator child = node->neighbors.begin(); child != node->neighbors.end(); ++child) {
+		if(!isChild(*child, node))
+			continue;
+		const long i = getBranchIndex(node, *child);
+		if(isLikValid(i * numPattern, numPattern)) /* already evaluated */
+			continue;
+		for(int b = 0; b < numPattern; b += LIK_BLOCK_SIZE) {
+#pragma omp task if(numPattern > LIK_BLOCK_SIZE)
+			calcBranchLik(node, *child, i, b, std::min(b + LIK_BLOCK_SIZE - 1, numPattern - 1));
+		}
+	}
+#pragma omp taskwait
+	/* evaluate the subtrees of each child in parallel */
+	for(vector<PTUNodePtr>::const_iterator child = node->neighbors.begin(); child != node->neighbors.end(); ++child) {
+		if(isChild(*child, node)) {
+#pragma omp task
+			evaluateOutward(*child);
+		}
+	}
+#pragma omp taskwait
+}
+
+void PTUnrooted::calcBranchLik(const PTUNodePtr& node, const PTUNodePtr& to, long i, int start, int end) {
+	long k = i * numPattern + start;
+	if(!singlePrec)
+		calcLik(node, to, start, end, arena.lik.col(k).data(), arena.scale.data() + k);
+	else {
+		Matrix4Xd lik(4, end - start + 1);
+		calcLik(node, to, start, end, lik.data(), arena.scale.data() + k);
+		arena.likF.middleCols(k, lik.cols()) = lik.cast<float>();
 	}
 }
 
@@ -444,14 +785,30 @@ Vector4d PTUnrooted::getModelFreqEst() const {
 	return freq;
 }
 
-istream& PTUnrooted::load(istream& in) {
+istream& PTUnrooted::load(istream& in, const string& mapFn) {
 	/* init leaf matrix that does not depend on anything */
 	initLeafMat();
 
+	/* read and check format tag and version before trusting any layout */
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	in.read((char*) &magic, sizeof(uint32_t));
+	in.read((char*) &version, sizeof(uint32_t));
+	if(in.bad())
+		return in;
+	if(magic != FORMAT_MAGIC || version != FORMAT_VERSION) {
+		cerr << "Incompatible phylogenetic tree format version " << (magic == FORMAT_MAGIC ? version : 1)
+				<< ", expecting " << FORMAT_VERSION << ", please rebuild the database with hmmufotu-build" << endl;
+		in.setstate(std::ios_base::badbit);
+		return in;
+	}
+
 	/* read global information */
 	size_t nNodes;
 	in.read((char*) &nNodes, sizeof(size_t));
 	in.read((char*) &csLen, sizeof(int));
+	in.read((char*) &singlePrec, sizeof(bool));
+	loadSitePatterns(in);
 
 	/* read each node */
 	for(size_t i = 0; i < nNodes; ++i) {
@@ -460,9 +817,13 @@ istream& PTUnrooted::load(istream& in) {
 		id2node.push_back(node);
 	}
 
+	/* read or map the branch arena of the root and all edges at once */
+	loadBranchArena(in, mapFn);
+
 	/* read all edges */
 	size_t nEdges;
 	in.read((char*) &nEdges, sizeof(size_t));
+	branchLength.reserve(branchLength.size() + nEdges);
 	for(size_t i = 0; i < nEdges; ++i)
 		loadEdge(in);
 
@@ -481,19 +842,37 @@ istream& PTUnrooted::load(istream& in) {
 	/* load models */
 	loadModel(in);
 	loadDGModel(in);
+	updateBranchPr(); /* memoize transition matrices with the loaded models */
+
+	packSeqs();
 
 	return in;
 }
 
+void PTUnrooted::packSeqs() {
+	id2packed.clear();
+	id2packed.reserve(numNodes());
+	for(vector<PTUNodePtr>::const_iterator node = id2node.begin(); node != id2node.end(); ++node)
+		id2packed.push_back(PackedSeq((*node)->seq));
+}
+
 ostream& PTUnrooted::save(ostream& out) const {
+	/* write format tag and version */
+	out.write((const char*) &FORMAT_MAGIC, sizeof(uint32_t));
+	out.write((const char*) &FORMAT_VERSION, sizeof(uint32_t));
+
 	/* write global information */
 	size_t nNodes = numNodes();
 	out.write((const char*) &nNodes, sizeof(size_t));
 	out.write((const char*) &csLen, sizeof(int));
+	out.write((const char*) &singlePrec, sizeof(bool));
+	saveSitePatterns(out);
 
 	/* write each node */
 	for(vector<PTUNodePtr>::const_iterator node = id2node.begin(); node != id2node.end(); ++node)
 		(*node)->save(out);
+	/* write the branch arena */
+	saveBranchArena(out);
 	/* write all edges */
 	size_t nEdges = numEdges();
 	out.write((const char*) &nEdges, sizeof(size_t));
@@ -548,7 +927,7 @@ ostream& PTUnrooted::saveEdge(ostream& out, const PTUNodePtr& node1, const PTUNo
 	out.write((const char*) &(node2->id), sizeof(long));
 	bool flag = isParent(node1, node2);
 	out.write((const char*) &flag, sizeof(bool));
-	getBranch(node1, node2).save(out); /* save branch data */
+	out.write((const char*) &branchLength[getBranchIndex(node1, node2)], sizeof(double));
 
 	return out;
 }
@@ -562,15 +941,87 @@ istream& PTUnrooted::loadEdge(istream& in) {
 
 	const PTUNodePtr& node1 = id2node[id1];
 	const PTUNodePtr& node2 = id2node[id2];
+	long i = newBranch(); /* lik of this branch are already in the arena */
 	node1->neighbors.push_back(node2);
+	node1->branches.push_back(i);
 	if(isParent)
 		node2->parent = node1;
-	/* construct a new empty branch and load */
-	node2branch[node1][node2].load(in);
+	in.read((char*) &branchLength[i], sizeof(double));
+
+	return in;
+}
+
+istream& PTUnrooted::loadBranchArena(istream& in, const string& mapFn) {
+	long nCol;
+	int enc;
+	size_t pad;
+	in.read((char*) &nCol, sizeof(long));
+	in.read((char*) &enc, sizeof(int));
+	in.read((char*) &pad, sizeof(size_t));
+	in.ignore(pad);
+	if(!in || !(BranchArena::DOUBLE_LIK <= enc && enc <= BranchArena::QUANT16_LIK) || !(nCol > 0 && nCol % numPattern == 0)) {
+		in.setstate(std::ios_base::badbit);
+		return in;
+	}
+	BranchArena::LikEncoding likEnc = static_cast<BranchArena::LikEncoding> (enc);
+	singlePrec = likEnc != BranchArena::DOUBLE_LIK;
+	quantized = likEnc == BranchArena::QUANT16_LIK;
+	std::streamoff offset = in.tellg();
+	if(!mapFn.empty() && in.good() && offset >= 0 && arena.mapFile(mapFn, offset, nCol, likEnc))
+		in.seekg(BranchArena::numBytes(nCol, likEnc), std::ios_base::cur); /* skip the mapped data */
+	else
+		arena.read(in, nCol, likEnc);
 
 	return in;
 }
 
+ostream& PTUnrooted::saveBranchArena(ostream& out) const {
+	/* the root branch and all other branches in the order of their saved edges */
+	vector<long> branchIdx(1, ROOT_BRANCH);
+	for(vector<PTUNodePtr>::const_iterator u = id2node.begin(); u != id2node.end(); ++u)
+		for(vector<PTUNodePtr>::const_iterator v = (*u)->neighbors.begin(); v != (*u)->neighbors.end(); ++v)
+			branchIdx.push_back(getBranchIndex(*u, *v));
+	long nCol = branchIdx.size() * numPattern;
+	int enc = quantized ? BranchArena::QUANT16_LIK : singlePrec ? BranchArena::FLOAT_LIK : BranchArena::DOUBLE_LIK;
+	out.write((const char*) &nCol, sizeof(long));
+	out.write((const char*) &enc, sizeof(int));
+	/* pad to the next page-aligned position, if known */
+	std::streamoff pos = out.tellp();
+	size_t pad = pos < 0 ? 0 : (BranchArena::PAGE_ALIGN - (pos + sizeof(size_t)) % BranchArena::PAGE_ALIGN) % BranchArena::PAGE_ALIGN;
+	out.write((const char*) &pad, sizeof(size_t));
+	out.write(string(pad, '\0').c_str(), pad);
+
+	for(vector<long>::const_iterator i = branchIdx.begin(); i != branchIdx.end(); ++i)
+		arena.writeLik(out, *i * numPattern, numPattern, static_cast<BranchArena::LikEncoding> (enc));
+	for(vector<long>::const_iterator i = branchIdx.begin(); i != branchIdx.end(); ++i)
+		out.write((const char*) (arena.scale.data() + *i * numPattern), sizeof(int) * numPattern);
+
+	return out;
+}
+
+istream& PTUnrooted::loadSitePatterns(istream& in) {
+	in.read((char*) &numPattern, sizeof(int));
+	site2pattern.resize(csLen);
+	in.read((char*) &site2pattern[0], csLen * sizeof(int));
+	/* restore the first site and weight of each pattern */
+	pattern2site.assign(numPattern, -1);
+	patternWeight.assign(numPattern, 0);
+	for(int j = 0; j < csLen; ++j) {
+		if(pattern2site[site2pattern[j]] == -1)
+			pattern2site[site2pattern[j]] = j;
+		patternWeight[site2pattern[j]]++;
+	}
+
+	return in;
+}
+
+ostream& PTUnrooted::saveSitePatterns(ostream& out) const {
+	out.write((const char*) &numPattern, sizeof(int));
+	out.write((const char*) &site2pattern[0], csLen * sizeof(int));
+
+	return out;
+}
+
 ostream& PTUnrooted::saveNodeHeight(ostream& out) const {
 	for(vector<PTUNodePtr>::const_iterator node = id2node.begin(); node != id2node.end(); ++node) {
 		out.write((const char*) &((*node)->id), sizeof(long));
@@ -595,15 +1046,20 @@ istream& PTUnrooted::loadNodeHeight(istream& in) {
 
 istream& PTUnrooted::loadRoot(istream& in) {
 	long rootId;
-	double* buf = new double[4 * csLen];
-	Map<Matrix4Xd> rootMap(buf, 4, csLen);
+	PTUBranch rootBranch(0, Matrix4Xd(4, numPattern), RowVectorXi(numPattern));
 	/* set current root */
 	in.read((char*) &rootId, sizeof(long));
 	root = id2node[rootId];
-	/* load current root loglik */
-	in.read((char*) buf, 4 * csLen * sizeof(double));
-	setBranchLoglik(root, PTUNodePtr(), rootMap);
-	delete[] buf;
+	/* load current root lik and scale */
+	if(singlePrec) {
+		Matrix4Xf likF(4, numPattern);
+		in.read((char*) likF.data(), likF.size() * sizeof(float));
+		rootBranch.lik = likF.cast<double>();
+	}
+	else
+		in.read((char*) rootBranch.lik.data(), rootBranch.lik.size() * sizeof(double));
+	in.read((char*) rootBranch.scale.data(), rootBranch.scale.size() * sizeof(int));
+	setBranch(root, nullNode, rootBranch);
 
 	return in;
 }
@@ -611,11 +1067,15 @@ istream& PTUnrooted::loadRoot(istream& in) {
 ostream& PTUnrooted::saveRoot(ostream& out) const {
 	/* save current root id */
 	out.write((const char*) &(root->id), sizeof(long));
-	double* buf = new double[4 * csLen];
-	Map<Matrix4Xd> inLoglikMap(buf, 4, csLen);
-	inLoglikMap = getBranchLoglik(root, nullNode);
-	out.write((const char*) buf, inLoglikMap.size() * sizeof(double));
-	delete[] buf;
+	/* save current root lik and scale */
+	const PTUBranch& rootBranch = getBranch(root, nullNode);
+	if(singlePrec) {
+		const Matrix4Xf& likF = rootBranch.lik.cast<float>();
+		out.write((const char*) likF.data(), likF.size() * sizeof(float));
+	}
+	else
+		out.write((const char*) rootBranch.lik.data(), rootBranch.lik.size() * sizeof(double));
+	out.write((const char*) rootBranch.scale.data(), rootBranch.scale.size() * sizeof(int));
 
 	return out;
 }
@@ -655,7 +1115,7 @@ ostream& PTUnrooted::saveDGModel(ostream& out) const {
 	return out;
 }
 
-double PTUnrooted::treeLoglik(const Vector4d& pi, const Matrix4Xd& X, int start, int end) {
+double PTUnrooted::treeLoglik(const Vector4d& pi, const Matrix4XdConstRef& X, int start, int end) {
 	double loglik = 0;
 	for(int j = start; j <= end; ++j)
 		loglik += treeLoglik(pi, X, j);
@@ -664,68 +1124,107 @@ double PTUnrooted::treeLoglik(const Vector4d& pi, const Matrix4Xd& X, int start,
 
 double PTUnrooted::treeLoglik(const PTUNodePtr& node, int start, int end) const {
 	double loglik = 0;
+	if(isCompressed() && start == 0 && end == csLen - 1) { /* sum over site patterns by their weights */
+		for(int p = 0; p < numPattern; ++p)
+			loglik += patternWeight[p] * treeLoglik(node, pattern2site[p]);
+		return loglik;
+	}
 	for(int j = start; j <= end; ++j)
 		loglik += treeLoglik(node, j);
 	return loglik;
 }
 
-PTUnrooted PTUnrooted::copySubTree(const PTUNodePtr& u, const PTUNodePtr& v) const {
-	assert(isParent(v, u));
-
-	PTUnrooted tree; /* construct an empty tree */
-	long id = 0;
-	tree.csLen = csLen; /* copy csLen */
-	tree.model = model; /* copy the DNA model */
-	tree.dG = dG; /* copy DiscreteGammaModel */
-
-	/* construct new copy of nodes, but the old sequences are ignored */
-	PTUNodePtr v2(new PTUNode(id++, v->name, v->anno, v->annoDist));
-	PTUNodePtr u2(new PTUNode(id++, u->name, u->anno, u->annoDist));
-	u2->parent = v2;
-
-	/* add nodes */
-	tree.id2node.push_back(v2);
-	tree.id2node.push_back(u2);
-	/* add edge */
-	tree.addEdge(u2, v2);
-
-	/* copy branch length and loglik */
-	tree.setBranch(u2, v2, getBranch(u, v));
-	tree.setBranch(v2, u2, getBranch(v, u));
-
-	tree.setRoot(v2);
-	return tree;
+const double* PTUnrooted::likCols(long i, int start, int end, Matrix4Xd& buf) const {
+	if(!isCompressed())
+		return likBlock(i * numPattern + start, end - start + 1, buf);
+	buf.resize(4, end - start + 1);
+	for(int j = start; j <= end; ++j)
+		buf.col(j - start) = likAt(likIndex(i, j));
+	return buf.data();
 }
 
-double PTUnrooted::optimizeBranchLength(const PTUNodePtr& u, const PTUNodePtr& v,
-		int start, int end, double maxL) {
-	assert(isParent(v, u));
+void PTUnrooted::calcPlacementDerivs(const double* U, const double* V, const double* N, int L,
+		const double* w, const double* dw, Matrix4Xd& dP, double& d1, double& d2) const {
+	const int K = numRates();
+	const Vector4d& pi = model->getPi();
+	const double* X[3] = { U, V, N };
+
+	/* P, dP / dt and d2P / dt2 of every category and branch along direction dw, at columns [4 * (3 * (3 * k + b) + n), ...) */
+	dP.resize(4, 36 * K);
+	for(int k = 0; k < K; ++k) {
+		double r = dG == nulldG ? 1 : dG->rate(k);
+		for(int b = 0; b < 3; ++b) {
+			const int i = 3 * (3 * k + b);
+			dP.middleCols<4>(4 * i) = model->Pr(w[b] * r);
+			if(dw[b] != 0) {
+				dP.middleCols<4>(4 * (i + 1)) = dw[b] * r * model->dPr(w[b] * r, 1);
+				dP.middleCols<4>(4 * (i + 2)) = dw[b] * dw[b] * r * r * model->dPr(w[b] * r, 2);
+			}
+		}
+	}
 
-	double w0 = getBranchLength(u, v);
+	d1 = d2 = 0;
+	for(int j = 0; j < L; ++j) {
+		double f = 0;
+		double f1 = 0;
+		double f2 = 0;
+		for(int k = 0; k < K; ++k) {
+			Vector4d Y[3]; /* P * X */
+			Vector4d Y1[3]; /* dP / dt * X */
+			for(int b = 0; b < 3; ++b) {
+				const Map<const Vector4d> x(X[b] + 4 * j);
+				const int i = 3 * (3 * k + b);
+				Y[b].noalias() = dP.middleCols<4>(4 * i) * x;
+				Y1[b].noalias() = dw[b] != 0 ? Vector4d(dP.middleCols<4>(4 * (i + 1)) * x) : Vector4d(Vector4d::Zero());
+			}
+			const Vector4d& piY = pi.cwiseProduct(Y[0]).cwiseProduct(Y[1]).cwiseProduct(Y[2]);
+			f += piY.sum();
+			for(int b = 0; b < 3; ++b) {
+				if(dw[b] == 0)
+					continue;
+				const Map<const Vector4d> x(X[b] + 4 * j);
+				const int i = 3 * (3 * k + b);
+				const Vector4d& Z = pi.cwiseProduct(Y[(b + 1) % 3]).cwiseProduct(Y[(b + 2) % 3]);
+				f1 += Z.dot(Y1[b]);
+				f2 += Z.dot(dP.middleCols<4>(4 * (i + 2)) * x);
+				for(int c = b + 1; c < 3; ++c)
+					if(dw[c] != 0)
+						f2 += 2 * pi.cwiseProduct(Y1[b]).cwiseProduct(Y1[c]).dot(Y[3 - b - c]);
+			}
+		}
+		if(!(f > 0))
+			continue;
+		/* d log(f) and d2 log(f), where the constant 1 / K and the scales cancel */
+		double g1 = f1 / f;
+		d1 += g1;
+		d2 += f2 / f - g1 * g1;
+	}
+}
 
+double PTUnrooted::optimizeBranchLengthEM(const Vector4d& pi, const double* U, const double* V, int L,
+		double w0, double maxL, double* A, double* B) {
 	double q0 = ::exp(-w0);
 	double p0 = 1 - q0;
 
 	double p = p0;
 	double q = q0;
 
-	const Vector4d& pi = model->getPi();
-
-	const Matrix4Xd& U = getBranchLoglik(u, v);
-	const Matrix4Xd& V = getBranchLoglik(v, u);
+	/* A = pi * (U .* V) and B = (pi * U) * (pi * V) at each site, with the same scale */
+	const Map<const Matrix4Xd> UMat(U, 4, L);
+	const Map<const Matrix4Xd> VMat(V, 4, L);
+	for(int j = 0; j < L; ++j) {
+		A[j] = pi.dot(UMat.col(j).cwiseProduct(VMat.col(j)));
+		B[j] = pi.dot(UMat.col(j)) * pi.dot(VMat.col(j));
+	}
 	/* Felsenstein's iterative optimizing algorithm */
 	for(int iter = 0; iter < MAX_ITER && p >= 0 && p <= 1; ++iter) {
 		p = 0;
 		int N = 0;
-		for(int j = start; j <= end; ++j) {
-			double logA = dot_product_scaled(pi, U.col(j) + V.col(j));
-			double logB = dot_product_scaled(pi, U.col(j)) + dot_product_scaled(pi, V.col(j));
-			if(::isnan(logA) || ::isnan(logB))
+		for(int j = 0; j < L; ++j) {
+			double D = A[j] * q0 + B[j] * p0;
+			if(!(D > 0))
 				continue;
-			double scale = std::max(logA, logB);
-			logA -= scale;
-			logB -= scale;
-			p += ::exp(logB) * p0 / (::exp(logA) * q0 + ::exp(logB) * p0);
+			p += B[j] * p0 / D;
 			N++;
 		}
 		p /= N;
@@ -742,61 +1241,9 @@ double PTUnrooted::optimizeBranchLength(const PTUNodePtr& u, const PTUNodePtr& v
 	double w = -::log(q); // final estimation
 	if(w > maxL)
 		w = maxL;
-	setBranchLength(u, v, w);
-//	cerr << "w0: " << w0 << " w: " << w << endl;
-
 	return w;
 }
 
-double PTUnrooted::optimizeBranchLength(const PTUNodePtr& u, const PTUNodePtr& v, const PTUNodePtr& r, const PTUNodePtr& n,
-		int start, int end) {
-	assert(root == r && isParent(r, u) && isParent(r, v) && isParent(r, n));
-
-	double wur0 = getBranchLength(u, r);
-	double wvr0 = getBranchLength(v, r);
-	double wnr0 = getBranchLength(n, r);
-	double w0 = wur0 + wvr0;
-
-//	debugLog << "wur0: " << wur0 << " wvr0: " << wvr0 << " wnr0: " << wnr0 << " w0: " << w0 << endl;
-
-	double wur = wur0;
-	double wvr = wvr0;
-	double wnr = wnr0;
-
-	/* every outgoing loglik(r,u), loglik(r,v) and loglik(r,n) depends on the other two incoming loglik */
-	for(int iter = 0; iter < MAX_ITER && 0 <= wur && wur <= w0; ++iter) {
-//		debugLog << "i: " << iter << " wur: " << wur << " wvr: " << wvr << " wnr: " << wnr << " w0: " << w0 << endl;
-		/* evaluate loglik(r, n) and update wnr */
-		setRoot(n);
-		resetLoglik(r, n, start, end);
-		evaluate(n, start, end);
-		wnr = optimizeBranchLength(r, n, start, end, 1); /* do not use branch length > 1 */
-		/* update loglik(r,u) and wur */
-		setRoot(u);
-		resetLoglik(r, u, start, end);
-		evaluate(u, start, end);
-		wur = optimizeBranchLength(r, u, start, end, w0);
-		/* update wvr and loglik(r, v) */
-		wvr = w0 - wur;
-		setRoot(v);
-		setBranchLength(r, v, wvr);
-		resetLoglik(r, v, start, end);
-		evaluate(v, start, end);
-
-		setRoot(r);
-
-		if(::abs(wur - wur0) < BRANCH_EPS && ::abs(wnr - wnr0) < BRANCH_EPS)
-			break;
-
-		wur0 = wur;
-		wvr0 = wvr;
-		wnr0 = wnr;
-	}
-//	cerr << "Estimated ratio: " << wur / w0 << endl;
-
-	return wur / w0;
-}
-
 PTUnrooted::PTPlacement PTUnrooted::estimateSeq(const DigitalSeq& seq, const PTLoc& loc, const string& method) const {
 	assert(seq.length() == csLen);
 	PTUnrooted::PTUNodePtr u = getNode(loc.id);
@@ -809,97 +1256,177 @@ PTUnrooted::PTPlacement PTUnrooted::estimateSeq(const DigitalSeq& seq, const PTL
 		ratio = 0.5;
 	/* estimate wnr */
 	double w0 = getBranchLength(u, v);
-	const Matrix4Xd& U = getBranchLoglik(u, v);
-	const Matrix4Xd& V = getBranchLoglik(v, u);
-	const Matrix4Xd& N = getLeafLoglik(seq, loc.start, loc.end);
+	const long iu = getBranchIndex(u, v);
+	const long iv = getBranchIndex(v, u);
 	double wur = w0 * ratio;
 	double wvr = w0 - wur;
 
-	const Matrix4Xd& UPr = dot_product_scaled(model->Pr(wur), U, loc.start, loc.end); /* U*P(wur) */
-	const Matrix4Xd& VPr = dot_product_scaled(model->Pr(wvr), V, loc.start, loc.end); /* V*P(wvr) */
-	double wnr = estimateBranchLength(UPr + VPr /* R */, N, loc.start, loc.end, method);
+	/* R = U*P(wur) .* V*P(wvr) and N in the region, both in probability space */
+	const int L = loc.end - loc.start + 1;
+	Matrix4Xd bufU, bufV;
+	const double* U = likCols(iu, loc.start, loc.end, bufU);
+	const double* V = likCols(iv, loc.start, loc.end, bufV);
+	const Matrix4d& UP = model->Pr(wur);
+	const Matrix4d& VP = model->Pr(wvr);
+	Matrix4Xd R = Matrix4Xd::Ones(4, L);
+	LikKernel::transMultProd(UP.data(), U, R.data(), L);
+	LikKernel::transMultProd(VP.data(), V, R.data(), L);
+	Matrix4Xd N(4, L);
+	for(int j = loc.start; j <= loc.end; ++j)
+		N.col(j - loc.start) = getLeafLik(seq, j);
+	double wnr = estimateBranchLength(R, N, 0, L - 1, method);
 
 	/* estimate loglik */
-	double loglik = treeLoglik(model->getPi(),
-			UPr + VPr + dot_product_scaled(model->Pr(wnr), N), /* N*P(wnr) */
-			loc.start, loc.end);
+	const Vector4d& pi = model->getPi();
+	const Matrix4d& NP = model->Pr(wnr);
+	LikKernel::transMultProd(NP.data(), N.data(), R.data(), L); /* R .* N*P(wnr) */
+	double loglik = 0;
+	for(int j = loc.start; j <= loc.end; ++j)
+		loglik += ::log(pi.dot(R.col(j - loc.start))) - (arena.scale(likIndex(iu, j)) + arena.scale(likIndex(iv, j))) * LOG_LIK_SCALE;
 
 	return PTPlacement(loc.start, loc.end, u, v, ratio, wnr, loglik);
 }
 
-double PTUnrooted::placeSeq(const DigitalSeq& seq, const PTUNodePtr& u, const PTUNodePtr& v,
-		int start, int end, double ratio0, double wnr0) {
-//	cerr << "Placing seq " << seq.getName() << " at " << u->getId() << "->" << v->getId() <<
-//			" start: " << start << " end: " << end << " ratio0: " << ratio0 << " wnr0: " << wnr0 << endl;
+double PTUnrooted::placeSeq(const DigitalSeq& seq, PTPlacement& place) const {
 	assert(seq.length() == csLen); /* make sure this is an aligned seq */
-	assert(isParent(v, u));
-	assert(0 <= ratio0 && ratio0 <= 1);
-
-	/* break the connection of u and v */
-	double w0 = getBranchLength(u, v);
-	removeEdge(u, v);
-	/* create a new interior root */
-	PTUNodePtr r(new PTUNode(numNodes(), ""));
-	/* create a new leaf with given seq */
-	PTUNodePtr n(new PTUNode(numNodes() + 1, "", seq));
-	n->parent = r;
-	u->parent = r;
-	v->parent = r;
-	setRoot(r);
-	/* add new nodes */
-	id2node.push_back(r);
-	id2node.push_back(n);
-	/* place r at the ratio0 = wur0 / w0 */
-	addEdge(u, r);
-	addEdge(v, r);
-	setBranch(u, r, getBranch(u, v));
-	setBranch(v, r, getBranch(v, u));
-	setBranchLength(u, r, w0 * ratio0);
-	setBranchLength(v, r, w0 * (1 - ratio0));
-	setBranchLoglik(r, u, Matrix4Xd::Constant(4, csLen, INVALID_LOGLIK));
-	setBranchLoglik(r, v, Matrix4Xd::Constant(4, csLen, INVALID_LOGLIK));
-	/* place r with initial branch length */
-	addEdge(n, r);
-	setBranchLength(n, r, wnr0);
-	setBranchLoglik(r, n, Matrix4Xd::Constant(4, csLen, INVALID_LOGLIK));
-	setBranchLoglik(n, r, Matrix4Xd::Constant(4, csLen, INVALID_LOGLIK));
-	/* evaluate new incoming messages */
-	evaluate(r, start, end); /* n->r evaluated */
-
-	/* joint optimization */
-	optimizeBranchLength(u, v, r, n, start, end);
-	initRootLoglik();
-	for(int j = start; j <= end; ++j) /* calculate root loglik */
-		loglik(r, j);
+	assert(isParent(place.pNode, place.cNode));
+	assert(0 <= place.ratio && place.ratio <= 1);
 
-	return treeLoglik(start, end);
-}
+	const int start = place.start;
+	const int end = place.end;
+	const int L = end - start + 1;
+	const int K = numRates();
+	const Vector4d& pi = model->getPi();
 
-PTUnrooted PTUnrooted::placeSeq(const DigitalSeq& seq, PTPlacement& place) const {
-	double ratio0 = place.ratio;
+	/* incoming lik U = u->r and V = v->r in the placement region, and all workspaces allocated once */
+	Matrix4Xd bufU, bufV;
+	const double* U = likCols(getBranchIndex(place.cNode, place.pNode), start, end, bufU);
+	const double* V = likCols(getBranchIndex(place.pNode, place.cNode), start, end, bufV);
+	const RowVectorXi& US = getBranchScale(place.cNode, place.pNode, start, end);
+	const RowVectorXi& VS = getBranchScale(place.pNode, place.cNode, start, end);
+	Matrix4Xd N(4, L); /* incoming lik n->r */
+	RowVectorXi NS(L);
+	Matrix4Xd M(4, L); /* outgoing lik r->n or r->u */
+	RowVectorXi MS(L);
+	Matrix4Xd likMat(4, K * L); /* lik of each rate category */
+	VectorXd A(L);
+	VectorXd B(L);
+	Matrix4Xd PU, PV, PN; /* transition matrices of each branch around r */
+	Matrix4Xd dP; /* transition matrices and their derivatives for Newton-Raphson iterations */
+
+	/* leaf lik of the new seq n */
+	Matrix4Xd leafLik(4, L);
+	for(int j = 0; j < L; ++j)
+		leafLik.col(j) = getLeafLik(seq, start + j);
+	likMat.setOnes();
+	NS.setZero();
+	multLeafLik(leafLik, likMat, K, NS.data());
+	avgLik(likMat, K, N.data());
+
+	/* place r at ratio = wur / w0 */
+	const double w0 = getBranchLength(place.cNode, place.pNode);
+	double wur0 = w0 * place.ratio;
+	double wvr0 = w0 * (1 - place.ratio);
 	double wnr0 = place.wnr;
-	double loglik0 = place.loglik;
+	const double W = wur0 + wvr0;
+	double wur = wur0;
+	double wvr = wvr0;
+	double wnr = wnr0;
+
+	/* Newton-Raphson iterations alternating between moving r along u-v and changing wnr */
+	const double dRatio[3] = { 1, -1, 0 };
+	const double dN[3] = { 0, 0, 1 };
+	double w[3] = { wur, wvr, wnr };
+	bool converged = false;
+	for(int iter = 0; iter < MAX_ITER; ++iter) {
+		double d1, d2;
+		calcPlacementDerivs(U, V, N.data(), L, w, dN, dP, d1, d2);
+		if(!(d2 < 0)) /* not concave */
+			break;
+		double wnr1 = w[2] - d1 / d2;
+		if(wnr1 < 0)
+			wnr1 = 0;
+		if(wnr1 > 1) /* do not use branch length > 1 */
+			wnr1 = 1;
+		double dwnr = wnr1 - w[2];
+		w[2] = wnr1;
+
+		calcPlacementDerivs(U, V, N.data(), L, w, dRatio, dP, d1, d2);
+		if(!(d2 < 0)) /* not concave */
+			break;
+		double wur1 = w[0] - d1 / d2;
+		if(wur1 < 0) /* stop at either end of u-v */
+			wur1 = 0;
+		if(wur1 > W)
+			wur1 = W;
+		double dwur = wur1 - w[0];
+		w[0] = wur1;
+		w[1] = W - wur1;
+
+		if(::fabs(dwur) < BRANCH_EPS && ::fabs(dwnr) < BRANCH_EPS) {
+			converged = true;
+			break;
+		}
+	}
+	if(converged) {
+		wur = w[0];
+		wvr = w[1];
+		wnr = w[2];
+	}
+	calcTransPr(wur, PU);
+	calcTransPr(wvr, PV);
+	calcTransPr(wnr, PN);
+
+	/* fall back to Felsenstein's iterative algorithm,
+	 * where every outgoing lik r->u, r->v and r->n depends on the other two incoming lik */
+	for(int iter = 0; !converged && iter < MAX_ITER && 0 <= wur && wur <= W; ++iter) {
+		/* evaluate lik r->n and update wnr */
+		likMat.setOnes();
+		MS.setZero();
+		multLik(PU.data(), U, US.data(), likMat, K, MS.data());
+		multLik(PV.data(), V, VS.data(), likMat, K, MS.data());
+		avgLik(likMat, K, M.data());
+		wnr = optimizeBranchLengthEM(pi, M.data(), N.data(), L, wnr, 1, A.data(), B.data()); /* do not use branch length > 1 */
+		calcTransPr(wnr, PN);
+		/* evaluate lik r->u and update wur */
+		likMat.setOnes();
+		MS.setZero();
+		multLik(PV.data(), V, VS.data(), likMat, K, MS.data());
+		multLik(PN.data(), N.data(), NS.data(), likMat, K, MS.data());
+		avgLik(likMat, K, M.data());
+		wur = optimizeBranchLengthEM(pi, M.data(), U, L, wur, W, A.data(), B.data());
+		calcTransPr(wur, PU);
+		/* update wvr */
+		wvr = W - wur;
+		calcTransPr(wvr, PV);
+
+		if(::fabs(wur - wur0) < BRANCH_EPS && ::fabs(wnr - wnr0) < BRANCH_EPS)
+			break;
 
-	PTUnrooted subtree = copySubTree(place.cNode, place.pNode);
-	const PTUnrooted::PTUNodePtr& v = subtree.getNode(0);
-	const PTUnrooted::PTUNodePtr& u = subtree.getNode(1);
-	double w0 = subtree.getBranchLength(u, v);
+		wur0 = wur;
+		wnr0 = wnr;
+	}
 
-	/* update loglik */
-	place.loglik = subtree.placeSeq(seq, u, v, place.start, place.end, ratio0, wnr0);
-	const PTUnrooted::PTUNodePtr& r = subtree.getNode(2);
-	const PTUnrooted::PTUNodePtr& n = subtree.getNode(3);
+	/* final lik at r */
+	likMat.setOnes();
+	MS.setZero();
+	multLik(PU.data(), U, US.data(), likMat, K, MS.data());
+	multLik(PV.data(), V, VS.data(), likMat, K, MS.data());
+	multLik(PN.data(), N.data(), NS.data(), likMat, K, MS.data());
+	avgLik(likMat, K, M.data());
+	double loglik = 0;
+	for(int j = 0; j < L; ++j)
+		loglik += ::log(pi.dot(M.col(j))) - MS(j) * LOG_LIK_SCALE;
 
 	/* update placement info */
-	place.wnr = subtree.getBranchLength(n, r);
-	double wur = subtree.getBranchLength(u, r);
-	double wvr = w0 - wur;
+	place.wnr = wnr;
 	place.ratio = wur / w0;
-
+	wvr = w0 - wur;
 	place.height = getHeight(place.cNode) + wur;
 	place.annoDist = wvr <= wur ? wvr + place.wnr : wur + place.wnr;
-	/* update other placement info */
-	return subtree;
+	place.loglik = loglik;
+
+	return loglik;
 }
 
 bool PhyloTreeUnrooted::isFullCanonicalName(const string& taxon) {
@@ -964,35 +1491,31 @@ size_t PhyloTreeUnrooted::estimateNumMutations(int j) const {
 	return N;
 }
 
-double PTUnrooted::estimateBranchLengthUnweighted(const Matrix4Xd& U, const Matrix4Xd& V, int start, int end) {
+double PTUnrooted::estimateBranchLengthUnweighted(const Matrix4XdConstRef& U, const Matrix4XdConstRef& V, int start, int end) {
 	assert(U.cols() == V.cols());
 	assert(0 <= start && start <= end && end < U.cols());
 
 	double d = 0;
 	for(int j = start; j <= end; ++j) {
-		const Vector4d& logU = U.col(j);
-		const Vector4d& logV = V.col(j);
-		int8_t b1 = inferState(logU);
-		int8_t b2 = inferState(logV);
+		int8_t b1, b2;
+		U.col(j).maxCoeff(&b1);
+		V.col(j).maxCoeff(&b2);
 		if(b1 != b2)
 			d++;
 	}
 	return d / (end - start + 1);
 }
 
-double PTUnrooted::estimateBranchLengthWeighted(const Matrix4Xd& U, const Matrix4Xd& V, int start, int end) {
+double PTUnrooted::estimateBranchLengthWeighted(const Matrix4XdConstRef& U, const Matrix4XdConstRef& V, int start, int end) {
 	assert(U.cols() == V.cols());
 	assert(0 <= start && start <= end && end < U.cols());
 
 	double d = 0;
 	double N = 0;
 	for(int j = start; j <= end; ++j) {
-		const Vector4d& logU = U.col(j);
-		const Vector4d& logV = V.col(j);
-		int8_t b1 = inferState(logU);
-		int8_t b2 = inferState(logV);
-		double w1 = inferWeight(logU)(b1);
-		double w2 = inferWeight(logV)(b2);
+		int8_t b1, b2;
+		double w1 = U.col(j).maxCoeff(&b1) / U.col(j).sum(); /* relative weight of the ML state */
+		double w2 = V.col(j).maxCoeff(&b2) / V.col(j).sum();
 		if(b1 != b2)
 			d += w1 * w2;
 		N += w1 * w2;
@@ -1000,37 +1523,6 @@ double PTUnrooted::estimateBranchLengthWeighted(const Matrix4Xd& U, const Matrix
 	return d / N;
 }
 
-ostream& PTUnrooted::PTUBranch::save(ostream& out) const {
-	out.write((const char*) &length, sizeof(double));
-	size_t N = loglik.size();
-	out.write((const char*) &N, sizeof(size_t));
-
-	double *buf = new double[N];
-	Map<Matrix4Xd> loglikMap(buf, 4, loglik.cols());
-	loglikMap = loglik; /* copy data */
-	out.write((const char*) buf, sizeof(double) * N);
-	delete[] buf;
-
-	return out;
-}
-
-istream& PTUnrooted::PTUBranch::load(istream& in) {
-	in.read((char*) &length, sizeof(double));
-	size_t N;
-	in.read((char*) &N, sizeof(size_t));
-	if(loglik.size() != N)
-		loglik.resize(4, N / 4);
-
-	double *buf = new double[N];
-	in.read((char*) buf, sizeof(double) * N);
-//	Map<Matrix4Xd> loglikMap(buf, 4, N / 4);
-//	loglik = loglikMap;
-	loglik = Map<Matrix4Xd>(buf, 4, N / 4); /* copy data */
-	delete[] buf;
-
-	return in;
-}
-
 void PTUnrooted::inferSeq(const PTUNodePtr& node) {
 	if(node->seq.length() == csLen) /* already inferred */
 		return;
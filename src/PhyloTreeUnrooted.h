@@ -22,6 +22,10 @@
  *  An Unrooted Phylogenic Tree (PTUnrooted)
  *  A PTUnrooted can be evaluated from any node as its root and yields same loglik
  *  as long as using a time-reversible DNA substitution model
+ *  Conditional likelihoods are cached in probability space, with an integer scale per site
+ *  so that the actual likelihood is lik * 2^(-LIK_SCALE_EXP * scale)
+ *  The cached lik can be stored in either double or single precision
+ *  Identical alignment columns are compressed into site patterns, the cached lik is stored once per pattern
  *  Internal Tree nodes are number indexed from 0 to N-1
  *  Created on: Dec 1, 2016
  *      Author: zhengqi
@@ -53,6 +57,8 @@
 #include "ProgLog.h"
 #include "StringUtils.h"
 #include "DigitalSeq.h"
+#include "PackedSeq.h"
+#include "BranchArena.h"
 #include "NewickTree.h"
 #include "MSA.h"
 #include "DNASubModel.h"
@@ -68,8 +74,10 @@ using std::set;
 using std::istream;
 using std::ostream;
 using Eigen::Matrix4Xd;
+using Eigen::Matrix4Xf;
 using Eigen::Matrix4d;
 using Eigen::RowVectorXd;
+using Eigen::RowVectorXi;
 using boost::shared_ptr;
 using boost::unordered_map;
 using boost::unordered_set;
@@ -106,8 +114,9 @@ public:
 	typedef shared_ptr<DNASubModel> ModelPtr; /* use boost shared_ptr to hold DNA Sub Model */
 	typedef shared_ptr<DiscreteGammaModel> DGammaPtr; /* use boost shared_ptr to hold DiscreteGammapModel */
 
-	typedef boost::unordered_map<PTUNodePtr, boost::unordered_map<PTUNodePtr, PTUBranch> > BranchMap;
 	typedef boost::unordered_map<PTUNodePtr, double> HeightMap;
+	typedef Eigen::Map<const RowVectorXi> BranchScaleMap; /* read-only view of a branch scale stored in the branch arena */
+	typedef Eigen::Ref<const Matrix4Xd> Matrix4XdConstRef; /* read-only reference to any 4 X N lik/loglik matrix without copying */
 
 	/**
 	 * A PTUnrooed node that stores its basic information and neighbors
@@ -352,6 +361,7 @@ public:
 		string name; /* node name, need to be unique for database loading */
 		DigitalSeq seq; /* sequence of this node */
 		vector<PTUNodePtr> neighbors; /* pointers to neighbors */
+		vector<long> branches; /* branch index of the outgoing branch to each neighbor, parallel to neighbors */
 		PTUNodePtr parent; /* pointer to parent node, set to null on default */
 
 		string anno;
@@ -368,20 +378,15 @@ public:
 		/** construct a branch with given length */
 		explicit PhyloTreeUnrootedBranch(double length) : length(length) {  }
 
-		/** construct a branch with given length and loglik */
-		PhyloTreeUnrootedBranch(double length, const Matrix4Xd& loglik) :
-			length(length), loglik(loglik)
+		/** construct a branch with given length, lik and scale */
+		PhyloTreeUnrootedBranch(double length, const Matrix4Xd& lik, const RowVectorXi& scale) :
+			length(length), lik(lik), scale(scale)
 		{ }
 
-		/** save this branch to a binary output */
-		ostream& save(ostream& out) const;
-
-		/** load data from a binary input to this branch */
-		istream& load(istream& in);
-
 	private:
 		double length; /* branch length */
-		Matrix4Xd loglik; /* outgoing message (loglik) of this branch, before convoluting into branch length */
+		Matrix4Xd lik; /* outgoing message (scaled lik) of this branch, before convoluting into branch length */
+		RowVectorXi scale; /* scale exponent of lik at each site */
 	};
 
 	/**
@@ -502,7 +507,7 @@ public:
 
 	/* constructors */
 	/** Default constructor, do nothing */
-	PhyloTreeUnrooted() : csLen(0) {  }
+	PhyloTreeUnrooted() : csLen(0), numPattern(0), branchLength(1), singlePrec(false), quantized(false), rootLoglikId(-1) {  }
 
 	/** Construct a PTUnrooted from a Newick Tree */
 	PhyloTreeUnrooted(const NewickTree& ntree);
@@ -529,11 +534,70 @@ public:
 		return csLen;
 	}
 
+	/** get number of distinct site patterns */
+	int numSitePatterns() const {
+		return numPattern;
+	}
+
+	/** test whether the aligned sites are compressed into fewer site patterns */
+	bool isCompressed() const {
+		return numPattern < csLen;
+	}
+
+	/**
+	 * slice this tree to keep only the aligned sites in region [start, end],
+	 * with node seqs, site patterns and the cached lik of every branch restricted to this region,
+	 * the cached lik are kept as is since every site is evaluated independently
+	 * @param start  0-based start on the alignment
+	 * @param end  0-based end on the alignment
+	 */
+	void slice(int start, int end);
+
+	/**
+	 * graft a new leaf with an aligned seq onto branch u->v of this tree,
+	 * by introducing a new interior node r at ratio = wur / wuv, and a new branch n->r of length wnr,
+	 * the cached lik of u->r and v->r are taken over from u->v and v->u as the subtrees behind them are unchanged,
+	 * while other affected cached lik are not updated until evaluateGrafted() is called
+	 * @param seq  aligned seq of the new leaf, its name is used as the node name
+	 * @param msaId  MSA id of the new leaf
+	 * @param u  branch start, a child of v
+	 * @param v  branch end
+	 * @param ratio  placement ratio on u->v
+	 * @param wnr  length of the new branch
+	 * @return  the new leaf node
+	 */
+	PTUNodePtr graftSeq(const DigitalSeq& seq, unsigned msaId, const PTUNodePtr& u, const PTUNodePtr& v, double ratio, double wnr);
+
+	/**
+	 * update this tree after grafting new leaves with graftSeq(),
+	 * the site patterns are re-compressed with the new leaves, and only the cached lik of branches
+	 * with a grafted leaf behind them are re-evaluated, then the seqs of all interior nodes are re-inferred
+	 * @param leaves  grafted leaves
+	 * @return  number of re-evaluated branches
+	 */
+	long evaluateGrafted(const vector<PTUNodePtr>& leaves);
+
 	/** get root node */
 	const PTUNodePtr& getRoot() const {
 		return root;
 	}
 
+	/**
+	 * pack the seq of every node for fast p-dist calculation,
+	 * which is done automatically after loading
+	 */
+	void packSeqs();
+
+	/** test whether the node seqs are packed */
+	bool isPacked() const {
+		return !id2packed.empty() && id2packed.size() == id2node.size();
+	}
+
+	/** get the packed seq of node i */
+	const PackedSeq& getPackedSeq(std::vector<PackedSeq>::size_type i) const {
+		return id2packed[i];
+	}
+
 	/** get MSA2Node index */
 	const map<unsigned, PTUNodePtr>& getMSA2NodeIndex() const {
 		return msaId2node;
@@ -564,16 +628,25 @@ public:
 		return id2node[i];
 	}
 
-	/** add a new edge u<->v to this tree */
+	/** add a new edge u<->v to this tree, with a new branch in each direction */
 	void addEdge(const PTUNodePtr& u, const PTUNodePtr& v) {
 		u->neighbors.push_back(v);
+		u->branches.push_back(newBranch());
 		v->neighbors.push_back(u);
+		v->branches.push_back(newBranch());
 	}
 
-	/** remove an edge u<->v to this tree */
+	/**
+	 * remove an edge u<->v to this tree
+	 * the arena space of the removed branches is not reclaimed
+	 */
 	void removeEdge(const PTUNodePtr& u, const PTUNodePtr& v) {
-		u->neighbors.erase(std::find(u->neighbors.begin(), u->neighbors.end(), v));
-		v->neighbors.erase(std::find(v->neighbors.begin(), v->neighbors.end(), u));
+		vector<PTUNodePtr>::iterator uv = std::find(u->neighbors.begin(), u->neighbors.end(), v);
+		u->branches.erase(u->branches.begin() + (uv - u->neighbors.begin()));
+		u->neighbors.erase(uv);
+		vector<PTUNodePtr>::iterator vu = std::find(v->neighbors.begin(), v->neighbors.end(), u);
+		v->branches.erase(v->branches.begin() + (vu - v->neighbors.begin()));
+		v->neighbors.erase(vu);
 	}
 
 	/**
@@ -590,26 +663,40 @@ public:
 	}
 
 	/**
-	 * get branch from u-> v
+	 * find the branch index of u->v, the cached root loglik is stored as the branch root->nullNode
+	 * @return  the branch index, or -1 if not exists
+	 */
+	long findBranch(const PTUNodePtr& u, const PTUNodePtr& v) const;
+
+	/**
+	 * get the branch index of u->v
 	 * @throw  out_of_range exception if not exists
 	 */
-	const PTUBranch& getBranch(const PTUNodePtr& u, const PTUNodePtr& v) const {
-		return node2branch.at(u).at(v);
+	long getBranchIndex(const PTUNodePtr& u, const PTUNodePtr& v) const {
+		long i = findBranch(u, v);
+		if(i < 0)
+			throw std::out_of_range("branch not exists in this tree");
+		return i;
 	}
 
 	/**
-	 * set branch from u-> v
+	 * get a copy of branch from u-> v
+	 * @throw  out_of_range exception if not exists
 	 */
-	void setBranch(const PTUNodePtr& u, const PTUNodePtr& v, const PTUBranch& w) {
-		node2branch[u][v] = w;
+	PTUBranch getBranch(const PTUNodePtr& u, const PTUNodePtr& v) const {
+		long i = getBranchIndex(u, v);
+		return PTUBranch(branchLength[i], likBlock(i * numPattern, numPattern), branchScaleAt(i));
 	}
 
 	/**
-	 * remove the branch from u->v
-	 * @return  the old branch
+	 * set branch from u-> v
 	 */
-	void removeBranch(const PTUNodePtr& u, const PTUNodePtr& v) {
-		node2branch[u].erase(node2branch[u].find(v));
+	void setBranch(const PTUNodePtr& u, const PTUNodePtr& v, const PTUBranch& w) {
+		long i = claimBranch(u, v);
+		branchLength[i] = w.length;
+		updateBranchPr(i);
+		setLikBlock(i * numPattern, w.lik);
+		arena.scale.segment(i * numPattern, numPattern) = w.scale;
 	}
 
 	/**
@@ -618,42 +705,90 @@ public:
 	 * @throw  out_of_range exception if branch not exists
 	 */
 	double getBranchLength(const PTUNodePtr& u, const PTUNodePtr& v) const {
-		return node2branch.at(u).at(v).length;
+		return branchLength[getBranchIndex(u, v)];
 	}
 
 	/**
 	 * set branch length from u <-> v
 	 */
 	void setBranchLength(const PTUNodePtr& u, const PTUNodePtr& v, double w) {
-		node2branch[u][v].length = node2branch[v][u].length = w;
+		long i = getBranchIndex(u, v);
+		long k = getBranchIndex(v, u);
+		branchLength[i] = branchLength[k] = w;
+		updateBranchPr(i);
+		updateBranchPr(k);
 	}
 
 	/**
 	 * get branch loglik of u->v at site j
 	 */
 	Vector4d getBranchLoglik(const PTUNodePtr& u, const PTUNodePtr& v, int j) const {
-		return node2branch.at(u).at(v).loglik.col(j);
+		long k = likIndex(getBranchIndex(u, v), j);
+		return lik2loglik(likAt(k), arena.scale(k));
 	}
 
 	/**
 	 * get branch loglik of u->v at all sites
 	 */
-	const Matrix4Xd& getBranchLoglik(const PTUNodePtr& u, const PTUNodePtr& v) const {
-		return node2branch.at(u).at(v).loglik;
+	Matrix4Xd getBranchLoglik(const PTUNodePtr& u, const PTUNodePtr& v) const;
+
+	/**
+	 * get a copy of branch scaled lik of u->v in region [start, end], in double precision
+	 */
+	Matrix4Xd getBranchLik(const PTUNodePtr& u, const PTUNodePtr& v, int start, int end) const {
+		long i = getBranchIndex(u, v);
+		Matrix4Xd lik(4, end - start + 1);
+		for(int j = start; j <= end; ++j)
+			lik.col(j - start) = likAt(likIndex(i, j));
+		return lik;
+	}
+
+	/**
+	 * get a copy of branch scaled lik of u->v at all sites, in double precision
+	 */
+	Matrix4Xd getBranchLik(const PTUNodePtr& u, const PTUNodePtr& v) const {
+		return getBranchLik(u, v, 0, csLen - 1);
+	}
+
+	/**
+	 * get a copy of branch lik scale of u->v in region [start, end]
+	 */
+	RowVectorXi getBranchScale(const PTUNodePtr& u, const PTUNodePtr& v, int start, int end) const {
+		long i = getBranchIndex(u, v);
+		RowVectorXi scale(end - start + 1);
+		for(int j = start; j <= end; ++j)
+			scale(j - start) = arena.scale(likIndex(i, j));
+		return scale;
+	}
+
+	/**
+	 * get a copy of branch lik scale of u->v at all sites
+	 */
+	RowVectorXi getBranchScale(const PTUNodePtr& u, const PTUNodePtr& v) const {
+		return getBranchScale(u, v, 0, csLen - 1);
 	}
 
 	/**
 	 * set branch loglik of u->v at site j
 	 */
 	void setBranchLoglik(const PTUNodePtr& u, const PTUNodePtr& v, int j, const Vector4d& loglik) {
-		node2branch[u][v].loglik.col(j) = loglik;
+		long k = likIndex(claimBranch(u, v), j);
+		Vector4d likVec;
+		arena.scale(k) = loglik2lik(loglik, likVec);
+		setLikBlock(k, likVec);
 	}
 
 	/**
 	 * set branch loglik of u->v at all sites
 	 */
-	void setBranchLoglik(const PTUNodePtr& u, const PTUNodePtr& v, const Matrix4Xd& loglik) {
-		node2branch[u][v].loglik = loglik;
+	void setBranchLoglik(const PTUNodePtr& u, const PTUNodePtr& v, const Matrix4XdConstRef& loglik) {
+		long i = claimBranch(u, v);
+		Vector4d likVec;
+		for(int j = 0; j < csLen; ++j) {
+			long k = likIndex(i, j);
+			arena.scale(k) = loglik2lik(loglik.col(j), likVec);
+			setLikBlock(k, likVec);
+		}
 	}
 
 	/**
@@ -707,6 +842,7 @@ public:
 	 */
 	void setModel(const DNASubModel& model) {
 		this->model.reset(model.clone());
+		updateBranchPr();
 	}
 
 	/**
@@ -714,6 +850,7 @@ public:
 	 */
 	void setModel(const DNASubModel* model) {
 		this->model.reset(model->clone());
+		updateBranchPr();
 	}
 
 	/**
@@ -735,6 +872,7 @@ public:
 	 */
 	void setDGModel(const DiscreteGammaModel& dG) {
 		this->dG.reset(dG.clone());
+		updateBranchPr();
 	}
 
 	/**
@@ -742,6 +880,7 @@ public:
 	 */
 	void setDGModel(const DiscreteGammaModel* dG) {
 		this->dG.reset(dG->clone());
+		updateBranchPr();
 	}
 
 	/**
@@ -751,13 +890,54 @@ public:
 		return dG;
 	}
 
+	/**
+	 * test whether the cached lik is stored in single precision
+	 */
+	bool isSinglePrec() const {
+		return singlePrec;
+	}
+
+	/**
+	 * set the storage precision of the cached lik, converting all cached values
+	 */
+	void setSinglePrec(bool flag);
+
+	/**
+	 * test whether the cached lik is saved 16-bit log-quantized
+	 */
+	bool isQuantized() const {
+		return quantized;
+	}
+
+	/**
+	 * set whether to save the cached lik 16-bit log-quantized, which also sets single precision,
+	 * quantized lik are decoded into single precision when loaded
+	 */
+	void setQuantized(bool flag);
+
 	/**
 	 * save PTUnrooted to binary output
 	 */
 	ostream& save(ostream& out) const;
 
 	/** load PTUnrooted from a binary input */
-	istream& load(istream& in);
+	istream& load(istream& in) {
+		return load(in, "");
+	}
+
+	/**
+	 * load PTUnrooted from a binary input of a file,
+	 * with the branch arena mapped from the file directly instead of read if possible
+	 * the input is set bad if it was written in an incompatible format version
+	 * @param in  binary input
+	 * @param mapFn  file name of the input, or empty to always read the branch arena
+	 */
+	istream& load(istream& in, const string& mapFn);
+
+	/** test whether the branch arena is mapped from a file */
+	bool isMapped() const {
+		return arena.isMapped();
+	}
 
 	/**
 	 * set tree root at given node, return the old node
@@ -798,26 +978,35 @@ public:
 	 * initiate the cached root loglik
 	 */
 	void initRootLoglik() {
-		node2branch[root][nullNode].loglik = Matrix4Xd::Constant(4, csLen, INVALID_LOGLIK);
+		initBranchArena();
+		resetRootLoglik();
 	}
 
 	/**
 	 * update the cached root loglik
 	 */
-	void updateRootLoglik();
+	void updateRootLoglik() {
+		updateRootLoglik(0, csLen - 1);
+	}
+
+	/**
+	 * update the cached root loglik at given region
+	 */
+	void updateRootLoglik(int start, int end);
 
 	/**
 	 * reset the cached loglik of edge u->v
 	 */
 	void resetLoglik(const PTUNodePtr& u, const PTUNodePtr& v) {
-		node2branch[u][v].loglik.setConstant(INVALID_LOGLIK);
+		invalidateLik(claimBranch(u, v) * numPattern, numPattern);
 	}
 
 	/**
 	 * reset the cached loglik of edge u->v at given region
 	 */
 	void resetLoglik(const PTUNodePtr& u, const PTUNodePtr& v, int start, int end) {
-		node2branch[u][v].loglik.block(0, start, 4, end - start + 1).setConstant(INVALID_LOGLIK);
+		patternRange(start, end);
+		invalidateLik(claimBranch(u, v) * numPattern + start, end - start + 1);
 	}
 
 	/**
@@ -829,30 +1018,42 @@ public:
 	 * reset the cached root loglik
 	 */
 	void resetRootLoglik() {
-		node2branch[root][nullNode].loglik.setConstant(INVALID_LOGLIK);
+		rootLoglikId = root->id;
+		invalidateLik(ROOT_BRANCH * numPattern, numPattern);
 	}
 
 	/**
-	 * evaluate the convoluted conditional loglik of the jth site of a subtree,
+	 * evaluate the convoluted conditional lik of the jth site of a subtree,
 	 * rooted at given node, with a given rate factor r
-	 * this is the base for all evaluate/loglik methods
+	 * the subtree must have been evaluated
 	 * @param node  subtree root
 	 * @param j  the jth aligned site
 	 * @param r  the rate factor at site j
-	 * @return  convoluted conditional loglik at the jth site
+	 * @return  convoluted conditional lik at the jth site, with the same scale as the subtree
 	 */
-	Vector4d loglikConv(const PTUNodePtr& node, int j, double r = 1) const;
+	Vector4d likConv(const PTUNodePtr& node, int j, double r = 1) const;
 
 	/**
-	 * evaluate the convoluted conditional loglik of the jth site of a subtree,
-	 * rooted at given node, with a given rate factor r
+	 * evaluate the conditional lik of the jth site of a subtree, rooted at given node
 	 * this is the base for all evaluate/loglik methods
 	 * @param node  subtree root
 	 * @param j  the jth aligned site
-	 * @param r  the rate factor at site j
-	 * @return  convoluted conditional loglik at the jth site
+	 * @param scale  scale exponent of the returned lik
+	 * @return  scaled conditional lik at the jth site
+	 */
+	Vector4d lik(const PTUNodePtr& node, int j, int& scale) const;
+
+	/**
+	 * evaluate the conditional loglik of the jth site of a subtree, rooted at given node
+	 * @param node  subtree root
+	 * @param j  the jth aligned site
+	 * @return  conditional loglik at the jth site
 	 */
-	Vector4d loglik(const PTUNodePtr& node, int j) const;
+	Vector4d loglik(const PTUNodePtr& node, int j) const {
+		int scale;
+		const Vector4d& likVec = lik(node, j, scale);
+		return lik2loglik(likVec, scale);
+	}
 
 	/**
 	 * evaluate the log-likelihood (loglik) of the entire tree
@@ -892,15 +1093,23 @@ public:
 	}
 
 	/**
-	 * evaluate the subtree at given node at given region
+	 * evaluate the subtree at given node at given region,
+	 * as OpenMP tasks of the enclosing parallel team, or of a new team if not called in a parallel region
 	 */
 	void evaluate(const PTUNodePtr& node, int start, int end);
 
+	/**
+	 * evaluate the branches of all directions, as if the tree were evaluated at every node as the root,
+	 * by a postorder pass towards the current root and a preorder pass away from it
+	 */
+	void evaluateAll();
+
 	/**
 	 * calculate the loglike of the subtree at site j
 	 */
 	double treeLoglik(const PTUNodePtr& node, int j) const {
-		return treeLoglik(model->getPi(), getBranchLoglik(node, node->parent), j);
+		long k = likIndex(getBranchIndex(node, node->parent), j);
+		return ::log(model->getPi().dot(likAt(k))) - arena.scale(k) * LOG_LIK_SCALE;
 	}
 
 	/**
@@ -1036,19 +1245,13 @@ public:
 		return getLeafLoglik(seq, 0, csLen - 1);
 	}
 
-	/**
-	 * make a copy of subtree with only two nodes and a branch u and v,
-	 * but ignore any assigned sequence
-	 * edges u->v and v->u should has already been evaluated
-	 * @return  a new PhyloTreeUnrooted with only two nodes and a branch u->v, and their branch loglik
-	 * with root set as v
-	 */
-	PTUnrooted copySubTree(const PTUNodePtr& u, const PTUNodePtr& v) const;
+	/** get leaf lik at site j assuming its seq is the given seq */
+	Vector4d getLeafLik(const DigitalSeq& seq, int j) const;
 
 	double estimateBranchLength(const PTUNodePtr& u, const PTUNodePtr& v,
 			int start, int end, const string& method = "weighted") const
 	{
-		return estimateBranchLength(getBranchLoglik(u, v), getBranchLoglik(v, u), start, end, method);
+		return estimateBranchLength(getBranchLik(u, v, start, end), getBranchLik(v, u, start, end), 0, end - start, method);
 	}
 
 	/**
@@ -1062,40 +1265,6 @@ public:
 		return estimateBranchLength(u, v, 0, csLen - 1, method);
 	}
 
-	/**
-	 * iteratively optimize the length of branch u->v using Felsenstein's algorithm
-	 * in given CSRegion [start-end], while the max length is optionally constrained
-	 * this method will use the original branch length as its initial guess
-	 * return the updated branch length v
-	 */
-	double optimizeBranchLength(const PTUNodePtr& u, const PTUNodePtr& v, int start, int end, double maxL = inf);
-
-	/**
-	 * iteratively optimize the length of branch u->v using Felsenstein's algorithm
-	 * return the updated branch length v
-	 */
-	double optimizeBranchLength(const PTUNodePtr& u, const PTUNodePtr& v, double maxL = inf) {
-		return optimizeBranchLength(u, v, 0, csLen - 1, inf);
-	}
-
-	/**
-	 * iteratively optimize the branch n->r, u->r and v->r jointly
-	 * in given CSRegion [start-end], so the total length wur + wrv won't changed, and wnr update accordingly
-	 * before calling this method, all incoming loglik n->r, u->r and v->r should be evaluated
-	 * return the optimized branch ratio (wur / wrv)
-	 */
-	double optimizeBranchLength(const PTUNodePtr& u, const PTUNodePtr& v, const PTUNodePtr& r, const PTUNodePtr& n,
-			int start, int end);
-
-	/**
-	 * iteratively optimize the branch n->r, u->r and v->r jointly
-	 * in the entire seq
-	 * return the optimized branch ratio (wur / wrv)
-	 */
-	double optimizeBranchLength(const PTUNodePtr& u, const PTUNodePtr& v, const PTUNodePtr& r, const PTUNodePtr& n) {
-		return optimizeBranchLength(u, v, r, n, 0, csLen - 1);
-	}
-
 	/**
 	 * estimate placement given a potential placement loc
 	 * the tree breaches will be only evaluated in one path in the order of wnr -> wur -> wvr
@@ -1106,48 +1275,16 @@ public:
 	 */
 	PTPlacement estimateSeq(const DigitalSeq& seq, const PTLoc& loc, const string& method = "weighted") const;
 
-	/**
-	 * place an additional seq (n) at given branch in given region [start,end]
-	 * by introducing a new internal root r, which will be placed at the initial ratio0 = wur / (wuv)
-	 * and the new branch n->r set to initial length wnr0
-	 * then all three new branches will be optimized jointly
-	 * the modified tree will have r as its new root
-	 * @param seq  new seq to be placed
-	 * @param u  branch start (u->v)
-	 * @param v  branch end (u->v)
-	 * @param start  seq start position (non-gap start)
-	 * @param end  seq end position (non-gap end)
-	 * @param ratio0  insert point
-	 * @param wnr0  new branch initial length
-	 * @return  the final treeLoglik after placing this read
-	 */
-	double placeSeq(const DigitalSeq& seq, const PTUNodePtr& u, const PTUNodePtr& v,
-			int start, int end, double ratio0, double wnr0);
-
 	/**
 	 * place an additional seq (n) at given placement position,
-	 * by copying a subtree at given position then do placement,
-	 * which will not affect the oroginal tree
+	 * by jointly optimizing the three branches around the new node directly on the incoming lik of the placement region
+	 * with Newton-Raphson iterations, or Felsenstein's iterative algorithm if they fail
 	 * after placement, all branch lengths, ratio and loglik will be updated
-	 * @param seq  new seq to be placed at a copy of subtree
+	 * @param seq  new seq to be placed
 	 * @param place  given placement position
-	 * @return  the subtree used for this placement
+	 * @return  the updated placement loglik
 	 */
-	PTUnrooted placeSeq(const DigitalSeq& seq, PTPlacement& place) const;
-
-	/**
-	 * place an additional seq (n) at given branch in the entire seq region
-	 * by introducing a new internal root r, which will be placed at the mid-point between u->v
-	 * the new branch n->r will be optimized, and direction loglik will be evaluated
-	 * @param  new seq to be placed
-	 * @param u  branch start (u->v)
-	 * @param v  branch end (u->v)
-	 * @return  the final treeLoglik after placing this read
-	 */
-	double placeSeq(const DigitalSeq& seq, const PTUNodePtr& u, const PTUNodePtr& v,
-			double ratio0, double wnr0) {
-		return placeSeq(seq, u, v, 0, csLen -1, ratio0, wnr0);
-	}
+	double placeSeq(const DigitalSeq& seq, PTPlacement& place) const;
 
 	/**
 	 * get posterial consensus sequence (CS) of a node using observed count data,
@@ -1182,10 +1319,31 @@ private:
 
 	/**
 	 * save an edge node1->node2 to a binary output
-	 * only the relationship between node IDs are stored
+	 * only the relationship between node IDs and the branch length are stored
 	 */
 	ostream& saveEdge(ostream& out, const PTUNodePtr& node1, const PTUNodePtr& node2) const;
 
+	/**
+	 * load the branch arena from a binary input, or map it from the input file if mapFn is not empty
+	 */
+	istream& loadBranchArena(istream& in, const string& mapFn);
+
+	/**
+	 * save the branch arena to a binary output, with the root branch first and the other branches in the order of their saved edges,
+	 * the lik and scale are padded to start at a page-aligned position of the output so they can be mapped directly
+	 */
+	ostream& saveBranchArena(ostream& out) const;
+
+	/**
+	 * load site patterns from a binary input
+	 */
+	istream& loadSitePatterns(istream& in);
+
+	/**
+	 * save site patterns to a binary output
+	 */
+	ostream& saveSitePatterns(ostream& out) const;
+
 	/**
 	 * load node height from a binary input
 	 */
@@ -1226,6 +1384,203 @@ private:
 	 */
 	ostream& saveDGModel(ostream& out) const;
 
+	/**
+	 * allocate a new branch in the branch arena with its lik set to INVALID_LIK
+	 * @return  the new branch index
+	 */
+	long newBranch();
+
+	/**
+	 * make sure the branch arena has room for the lik of every allocated branch,
+	 * a re-allocated arena has all lik set to INVALID_LIK
+	 */
+	void initBranchArena();
+
+	/**
+	 * get number of rate categories used in evaluation, 1 for fixed rate model
+	 */
+	int numRates() const {
+		return dG == nulldG ? 1 : dG->getK();
+	}
+
+	/**
+	 * get the memoized transition matrix P(w * r_k) of branch i at rate category k
+	 */
+	Eigen::Map<const Matrix4d> getBranchPr(long i, int k) const {
+		return Eigen::Map<const Matrix4d>(&branchPr[(i * numRates() + k) * 16]);
+	}
+
+	/**
+	 * update the memoized transition matrices of branch i after its length changed,
+	 * does nothing if the DNA model is not set yet
+	 */
+	void updateBranchPr(long i);
+
+	/**
+	 * re-allocate and update the memoized transition matrices of all branches,
+	 * needed whenever the DNA model or DiscreteGamma model is changed
+	 */
+	void updateBranchPr();
+
+	/**
+	 * get the branch index of u->v for writing,
+	 * the root branch is claimed by u and invalidated if it was cached for another node
+	 * @throw  out_of_range exception if not exists
+	 */
+	long claimBranch(const PTUNodePtr& u, const PTUNodePtr& v);
+
+	/**
+	 * calculate the transition matrices of every rate category at branch length w
+	 * @param P  output 4 X (4 * K) matrices, with category k at columns [4 * k, 4 * (k + 1))
+	 */
+	void calcTransPr(double w, Matrix4Xd& P) const;
+
+	/**
+	 * calculate the first and second derivatives of the placement loglik of a new node r
+	 * along a direction of the lengths of its three branches
+	 * @param U, V, N  incoming 4 X L lik of u->r, v->r and n->r
+	 * @param w  lengths of branch u-r, v-r and n-r
+	 * @param dw  direction of the change of the three branch lengths
+	 * @param dP  workspace of transition matrices
+	 * @param d1, d2  the first and second derivatives
+	 */
+	void calcPlacementDerivs(const double* U, const double* V, const double* N, int L,
+			const double* w, const double* dw, Matrix4Xd& dP, double& d1, double& d2) const;
+
+	/**
+	 * calculate the scaled conditional lik of a node in region [start, end] from its evaluated children
+	 * @param node  subtree root
+	 * @param lik  output 4 X (end - start + 1) lik block
+	 * @param scale  output scale of each site
+	 */
+	void calcLik(const PTUNodePtr& node, int start, int end, double* lik, int* scale) const {
+		calcLik(node, node->parent, start, end, lik, scale);
+	}
+
+	/**
+	 * calculate the scaled conditional lik of a node in region [start, end] towards a given neighbor,
+	 * from the evaluated branches of all its other neighbors
+	 * @param node  subtree root
+	 * @param to  the neighbor excluded, or nullNode to include all neighbors
+	 * @param lik  output 4 X (end - start + 1) lik block
+	 * @param scale  output scale of each site
+	 */
+	void calcLik(const PTUNodePtr& node, const PTUNodePtr& to, int start, int end, double* lik, int* scale) const;
+
+	/**
+	 * calculate the scaled conditional lik of a node at site patterns [start, end] into the ith branch of the arena
+	 */
+	void calcBranchLik(const PTUNodePtr& node, long i, int start, int end) {
+		calcBranchLik(node, node->parent, i, start, end);
+	}
+
+	/**
+	 * calculate the scaled conditional lik of a node towards a given neighbor at site patterns [start, end] into the ith branch of the arena
+	 */
+	void calcBranchLik(const PTUNodePtr& node, const PTUNodePtr& to, long i, int start, int end);
+
+	/**
+	 * evaluate the subtree at given node at site patterns [start, end],
+	 * with child subtrees and pattern blocks of each branch evaluated in OpenMP tasks
+	 */
+	void evaluatePatterns(const PTUNodePtr& node, int start, int end);
+
+	/**
+	 * evaluate all branches from a node towards its children, then the subtrees of its children recursively,
+	 * assuming all branches towards the root and the branch from its parent are evaluated
+	 */
+	void evaluateOutward(const PTUNodePtr& node);
+
+	/**
+	 * compress the aligned sites into distinct site patterns of the loaded leaf sequences
+	 */
+	void initSitePatterns();
+
+	/**
+	 * re-compress the aligned sites into site patterns after the node seqs are changed,
+	 * and gather the cached lik of every branch into the new patterns,
+	 * every new pattern must be identical to an old pattern at site start + j, i.e. by slicing or adding leaves
+	 * @param start  0-based start of the new aligned sites on the old aligned sites
+	 * @param L  number of the new aligned sites
+	 */
+	void recompressSitePatterns(int start, int L);
+
+	/** get the branch arena column of branch i at aligned site j */
+	long likIndex(long i, int j) const {
+		return i * numPattern + site2pattern[j];
+	}
+
+	/**
+	 * convert an aligned region [start, end] to a range of site patterns covering it,
+	 * which is the region itself if the sites are not compressed
+	 */
+	void patternRange(int& start, int& end) const {
+		if(isCompressed()) {
+			start = 0;
+			end = numPattern - 1;
+		}
+	}
+
+	/**
+	 * get a read-only pointer to the lik of branch i at aligned sites [start, end] in double precision,
+	 * pointing into the arena directly if possible, or into buf after gathering the site patterns
+	 */
+	const double* likCols(long i, int start, int end, Matrix4Xd& buf) const;
+
+	/** get the lik of the kth column of the branch arena */
+	Vector4d likAt(long k) const {
+		return singlePrec ? Vector4d(arena.likF.col(k).cast<double>()) : Vector4d(arena.lik.col(k));
+	}
+
+	/** get a copy of n columns of the branch arena starting at column k, in double precision */
+	Matrix4Xd likBlock(long k, long n) const {
+		return singlePrec ? Matrix4Xd(arena.likF.middleCols(k, n).cast<double>()) : Matrix4Xd(arena.lik.middleCols(k, n));
+	}
+
+	/**
+	 * get a read-only pointer to n columns of the branch arena starting at column k in double precision,
+	 * pointing into the arena directly, or into buf after conversion if the arena is in single precision
+	 */
+	const double* likBlock(long k, long n, Matrix4Xd& buf) const {
+		if(!singlePrec)
+			return arena.lik.data() + 4 * k;
+		buf = arena.likF.middleCols(k, n).cast<double>();
+		return buf.data();
+	}
+
+	/** set the branch arena columns starting at column k */
+	template<typename Derived>
+	void setLikBlock(long k, const Eigen::MatrixBase<Derived>& lik) {
+		if(singlePrec)
+			arena.likF.middleCols(k, lik.cols()) = lik.template cast<float>();
+		else
+			arena.lik.middleCols(k, lik.cols()) = lik;
+	}
+
+	/** set n columns of the branch arena starting at column k to INVALID_LIK */
+	void invalidateLik(long k, long n) {
+		if(singlePrec)
+			arena.likF.middleCols(k, n).setConstant(INVALID_LIK);
+		else
+			arena.lik.middleCols(k, n).setConstant(INVALID_LIK);
+	}
+
+	/** test whether n columns of the branch arena starting at column k are all evaluated */
+	bool isLikValid(long k, long n) const {
+		return singlePrec ? (arena.likF.middleCols(k, n).array() != static_cast<float> (INVALID_LIK)).all()
+				: (arena.lik.middleCols(k, n).array() != INVALID_LIK).all();
+	}
+
+	/**
+	 * grow the branch arena to at least nCol columns, with new lik set to INVALID_LIK
+	 */
+	void growBranchArena(long nCol);
+
+	/** get the scale view of the ith branch in the branch arena */
+	BranchScaleMap branchScaleAt(long i) const {
+		return BranchScaleMap(arena.scale.data() + i * numPattern, numPattern);
+	}
+
 
 public:
 	/* static methods */
@@ -1255,7 +1610,7 @@ public:
 	 * and leave all other region values unspecified,
 	 * scale the second matrix if necessary
 	 */
-	static Matrix4Xd dot_product_scaled(const Matrix4d& X, const Matrix4Xd& V, int start, int end);
+	static Matrix4Xd dot_product_scaled(const Matrix4d& X, const Matrix4XdConstRef& V, int start, int end);
 
 	/* return dot product between two matrix, scale the second matrix if necessary */
 	static Matrix4Xd dot_product_scaled(const Matrix4d& X, const Matrix4Xd& V) {
@@ -1304,43 +1659,103 @@ public:
 	/** Infer the relative weight of each state */
 	static Vector4d inferWeight(const Vector4d& loglik);
 
-	/** Estimate branch length using two incoming loglik Matrix in given region [start, end] */
-	static double estimateBranchLength(const Matrix4Xd& U, const Matrix4Xd& V,
+	/** Estimate branch length using two incoming scaled lik Matrix in given region [start, end] */
+	static double estimateBranchLength(const Matrix4XdConstRef& U, const Matrix4XdConstRef& V,
 			int start, int end, const string& method = "weighted");
 
-	/** Estimate branch length using two incoming loglik Matrix, using unweighted difference by ML infeerring */
-	static double estimateBranchLengthUnweighted(const Matrix4Xd& U, const Matrix4Xd& V,
+	/** Estimate branch length using two incoming scaled lik Matrix, using unweighted difference by ML infeerring */
+	static double estimateBranchLengthUnweighted(const Matrix4XdConstRef& U, const Matrix4XdConstRef& V,
 			int start, int end);
 
-	/** Estimate branch length using two incoming loglik Matrix, using unweighted difference by ML infeerring */
-	static double estimateBranchLengthWeighted(const Matrix4Xd& U, const Matrix4Xd& V,
+	/** Estimate branch length using two incoming scaled lik Matrix, using weighted difference by ML infeerring */
+	static double estimateBranchLengthWeighted(const Matrix4XdConstRef& U, const Matrix4XdConstRef& V,
 			int start, int end);
 
-	static double treeLoglik(const Vector4d& pi, const Matrix4Xd& X, int j) {
+	static double treeLoglik(const Vector4d& pi, const Matrix4XdConstRef& X, int j) {
 		return dot_product_scaled(pi, X.col(j));
 	}
 
-	static double treeLoglik(const Vector4d& pi, const Matrix4Xd& X, int start, int end);
+	static double treeLoglik(const Vector4d& pi, const Matrix4XdConstRef& X, int start, int end);
 
-	static double treeLoglik(const Vector4d& pi, const Matrix4Xd& X) {
+	static double treeLoglik(const Vector4d& pi, const Matrix4XdConstRef& X) {
 		return treeLoglik(pi, X, 0, X.cols() - 1);
 	}
 
 	/** initiate the leaf loglik matrix */
 	static Matrix4d initLeafMat();
 
+	/**
+	 * rescale each site of a lik block of K rate categories by 2^LIK_SCALE_EXP
+	 * until its max value is no less than MIN_LIK
+	 * @param lik  4 X (K * L) lik block to be rescaled in place, with category k at columns [k * L, (k + 1) * L)
+	 * @param K  number of rate categories
+	 * @param scale  scale exponent of each of the L sites to be increased by the number of rescaling
+	 */
+	static void rescaleLik(Matrix4Xd& lik, int K, int* scale);
+
+	/**
+	 * multiply each rate category of a lik block by an incoming lik X convoluted through its transition matrix, then rescale
+	 * @param P  K transition matrices of 4 X 4, one for each rate category
+	 * @param X  incoming 4 X L lik
+	 * @param XS  scale of incoming lik
+	 * @param lik  4 X (K * L) lik block to be updated in place
+	 * @param K  number of rate categories
+	 * @param scale  scale of each of the L sites to be updated in place
+	 */
+	static void multLik(const double* P, const double* X, const int* XS, Matrix4Xd& lik, int K, int* scale);
+
+	/**
+	 * multiply each rate category of a lik block by a 4 X L leaf lik, then rescale
+	 */
+	static void multLeafLik(const Matrix4Xd& leafLik, Matrix4Xd& lik, int K, int* scale);
+
+	/**
+	 * average a 4 X (K * L) lik block over its rate categories into a 4 X L output
+	 */
+	static void avgLik(const Matrix4Xd& likMat, int K, double* lik);
+
+	/**
+	 * optimize a branch length by Felsenstein's iterative algorithm given the 4 X L lik at both ends
+	 * @param A, B  workspace of L values
+	 * @return  the optimized branch length no larger than maxL
+	 */
+	static double optimizeBranchLengthEM(const Vector4d& pi, const double* U, const double* V, int L,
+			double w0, double maxL, double* A, double* B);
+
+	/** convert a scaled lik vector to loglik */
+	static Vector4d lik2loglik(const Vector4d& lik, int scale) {
+		return lik.array().log() - scale * LOG_LIK_SCALE;
+	}
+
+	/**
+	 * convert a loglik vector to scaled lik
+	 * @return  the scale exponent
+	 */
+	template<typename Derived>
+	static int loglik2lik(const Vector4d& loglik, const Eigen::MatrixBase<Derived>& lik);
+
 	static boost::unordered_set<PTUNodePtr> getAncestors(const boost::unordered_set<PTUNodePtr>& subset);
 
 	/* member fields */
 private:
 	int csLen; /* number of aligned sites */
+	int numPattern; /* number of distinct site patterns, the branch arena stores numPattern columns per branch */
+	vector<int> site2pattern; /* site pattern index of every aligned site */
+	vector<int> pattern2site; /* first aligned site of every site pattern */
+	vector<int> patternWeight; /* number of aligned sites of every site pattern */
 
 	PTUNodePtr root; /* root node of this tree */
 	vector<PTUNodePtr> id2node; /* indexed tree nodes */
+	vector<PackedSeq> id2packed; /* packed seq of indexed tree nodes */
 	map<unsigned, PTUNodePtr> msaId2node; /* original id in MSA to node map */
 	map<PTUNodePtr, unsigned> node2msaId; /* node to original id in MSA map */
 
-	BranchMap node2branch; /* branch length index storing edge length */
+	vector<double> branchLength; /* branch length of every branch, indexed by branch index */
+	vector<double> branchPr; /* memoized 4 X 4 transition matrices of every branch, one for each rate category */
+	bool singlePrec; /* whether the branch arena stores lik in single precision */
+	bool quantized; /* whether the branch arena is saved 16-bit log-quantized */
+	BranchArena arena; /* branch arena storing the outgoing scaled lik and lik scale of every branch, numPattern columns per branch */
+	long rootLoglikId; /* id of the node that the cached root loglik belongs to, -1 if none */
 	HeightMap node2height; /* node hight (distance to closest leaf */
 
 	ModelPtr model; /* DNA Model used to evaluate this tree, needed to be stored with this tree */
@@ -1348,15 +1763,23 @@ private:
 
 	static const DGammaPtr nulldG; /* internal null dG model */
 	static const PTUNodePtr nullNode; /* internal null node */
+	static const long ROOT_BRANCH = 0; /* branch index of the cached root loglik */
 
 public:
 	/* static fields */
 	static const double MIN_LOGLIK_EXP;
-	static const double INVALID_LOGLIK;
+	static const double INVALID_LIK;
+	static const int LIK_SCALE_EXP = 64; /* scale lik by 2^LIK_SCALE_EXP each time it drops below MIN_LIK, small enough for single precision */
+	static const int LIK_BLOCK_SIZE = 256; /* number of sites evaluated together as a block */
+	static const double MIN_LIK;
+	static const double LIK_SCALE;
+	static const double LOG_LIK_SCALE;
 
 	static const double LOGLIK_REL_EPS;
 	static const double BRANCH_EPS;
 	static const int MAX_ITER = 100;
+	static const uint32_t FORMAT_MAGIC = 0x4E555450; /* "PTUN" tag written before the tree data */
+	static const uint32_t FORMAT_VERSION = 2; /* bumped whenever the on-disk layout changes */
 	static const char ANNO_FIELD_SEP = '\t';
 	static const string DOMAIN_PREFIX;
 	static const string KINDOM_PREFIX;
@@ -1388,22 +1811,36 @@ inline size_t PTUnrooted::numLeaves() const {
 	return N;
 }
 
+inline long PTUnrooted::findBranch(const PTUNodePtr& u, const PTUNodePtr& v) const {
+	if(v == nullNode)
+		return u->id == rootLoglikId ? ROOT_BRANCH : -1;
+	for(vector<PTUNodePtr>::size_type k = 0; k < u->neighbors.size(); ++k)
+		if(u->neighbors[k] == v)
+			return u->branches[k];
+	return -1;
+}
+
+inline long PTUnrooted::claimBranch(const PTUNodePtr& u, const PTUNodePtr& v) {
+	if(v == nullNode && u->id != rootLoglikId) {
+		rootLoglikId = u->id;
+		invalidateLik(ROOT_BRANCH * numPattern, numPattern);
+	}
+	return getBranchIndex(u, v);
+}
+
 inline bool PTUnrooted::isEvaluated(const PTUNodePtr& u, const PTUNodePtr& v) const {
-	return node2branch.count(u) != 0 &&
-			node2branch.at(u).count(v) != 0 &&
-			(node2branch.at(u).at(v).loglik.array() != INVALID_LOGLIK).all();
+	return isEvaluated(u, v, 0, csLen - 1);
 }
 
 inline bool PTUnrooted::isEvaluated(const PTUNodePtr& u, const PTUNodePtr& v, int j) const {
-	return node2branch.count(u) != 0 &&
-			node2branch.at(u).count(v) != 0 &&
-			(node2branch.at(u).at(v).loglik.col(j).array() != INVALID_LOGLIK).all();
+	long i = findBranch(u, v);
+	return i >= 0 && isLikValid(likIndex(i, j), 1);
 }
 
 inline bool PTUnrooted::isEvaluated(const PTUNodePtr& u, const PTUNodePtr& v, int start, int end) const {
-	return node2branch.count(u) != 0 &&
-			node2branch.at(u).count(v) != 0 &&
-			(node2branch.at(u).at(v).loglik.block(0, start, 4, end - start + 1).array() != INVALID_LOGLIK).all();
+	long i = findBranch(u, v);
+	patternRange(start, end);
+	return i >= 0 && isLikValid(i * numPattern + start, end - start + 1);
 }
 
 inline Vector4d PTUnrooted::getLeafLoglik(const DigitalSeq& seq, int j) const {
@@ -1414,6 +1851,14 @@ inline Vector4d PTUnrooted::getLeafLoglik(const DigitalSeq& seq, int j) const {
 		return model->getPi().array().log();
 }
 
+inline Vector4d PTUnrooted::getLeafLik(const DigitalSeq& seq, int j) const {
+	int8_t base = seq[j];
+	if(base >= 0)
+		return Vector4d::Unit(base);
+	else
+		return model->getPi();
+}
+
 inline Matrix4Xd PTUnrooted::getLeafLoglik(const DigitalSeq& seq, int start, int end) const {
 	assert(seq.length() == csLen);
 	Matrix4Xd loglik = Matrix4Xd::Constant(4, csLen, infV);
@@ -1424,7 +1869,9 @@ inline Matrix4Xd PTUnrooted::getLeafLoglik(const DigitalSeq& seq, int start, int
 
 inline int8_t PhyloTreeUnrooted::inferState(const PTUNodePtr& u, const PTUNodePtr& v, int j) const {
 	assert(isParent(v, u) || isParent(u, v));
-	return PTUnrooted::inferState(getBranchLoglik(u, v, j));
+	int8_t state = 0;
+	likAt(likIndex(getBranchIndex(u, v), j)).maxCoeff(&state); /* scale does not change the ML state */
+	return state;
 }
 
 inline void PhyloTreeUnrooted::inferSeq() {
@@ -1463,7 +1910,7 @@ inline PTUnrooted::PTUNodePtr PhyloTreeUnrooted::randomLeaf(PTUNodePtr node) {
 	return node;
 }
 
-inline Matrix4Xd PTUnrooted::dot_product_scaled(const Matrix4d& X, const Matrix4Xd& Y, int start, int end) {
+inline Matrix4Xd PTUnrooted::dot_product_scaled(const Matrix4d& X, const Matrix4XdConstRef& Y, int start, int end) {
 	Matrix4Xd Z(4, Y.cols());
 	for(Matrix4Xd::Index j = start; j <= end; ++j)
 		Z.col(j) = dot_product_scaled(X, static_cast<const Vector4d&> (Y.col(j)));
@@ -1570,13 +2017,36 @@ inline Vector4d PTUnrooted::inferWeight(const Vector4d& loglik) {
 	return p / p.sum();
 }
 
+inline void PTUnrooted::rescaleLik(Matrix4Xd& lik, int K, int* scale) {
+	const Matrix4Xd::Index L = lik.cols() / K;
+	for(Matrix4Xd::Index j = 0; j < L; ++j) {
+		double maxV = 0;
+		for(int k = 0; k < K; ++k)
+			maxV = std::max(maxV, lik.col(k * L + j).maxCoeff());
+		while(maxV > 0 && maxV < MIN_LIK) {
+			for(int k = 0; k < K; ++k)
+				lik.col(k * L + j) *= LIK_SCALE;
+			maxV *= LIK_SCALE;
+			scale[j]++;
+		}
+	}
+}
+
+template<typename Derived>
+inline int PTUnrooted::loglik2lik(const Vector4d& loglik, const Eigen::MatrixBase<Derived>& lik) {
+	double maxV = loglik.maxCoeff();
+	int scale = maxV != infV && maxV < 0 ? static_cast<int> (-maxV / LOG_LIK_SCALE) : 0;
+	const_cast<Eigen::MatrixBase<Derived>&> (lik) = (loglik.array() + scale * LOG_LIK_SCALE).exp().matrix();
+	return scale;
+}
+
 inline Matrix4d PTUnrooted::initLeafMat() {
 	Matrix4d leafMat = Matrix4d::Constant(infV);
 	leafMat.diagonal().setConstant(0);
 	return leafMat;
 }
 
-inline double PTUnrooted::estimateBranchLength(const Matrix4Xd& U, const Matrix4Xd& V,
+inline double PTUnrooted::estimateBranchLength(const Matrix4XdConstRef& U, const Matrix4XdConstRef& V,
 		int start, int end, const string& method) {
 	if(method == "unweighted")
 		return estimateBranchLengthUnweighted(U, V, start, end);
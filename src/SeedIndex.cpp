@@ -0,0 +1,184 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * SeedIndex.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include <algorithm>
+#include <utility>
+#include "SeedIndex.h"
+
+namespace EGriceLab {
+namespace HmmUFOtu {
+
+using std::pair;
+
+const double SeedIndex::MAX_KEY_FREQ = 0.5;
+
+vector<SeedIndex::key_t> SeedIndex::getKeys(const DigitalSeq& seq, int start, int end) const {
+	vector<key_t> seqKeys;
+	const key_t mask = (static_cast<key_t>(1) << 2 * kmerSize) - 1;
+	key_t kmer = 0;
+	int n = 0; /* number of bases in current k-mer */
+	for(int j = start; j <= end; ++j) {
+		int b = seq[j];
+		if(b < 0) /* gaps are skipped */
+			continue;
+		kmer = (kmer << 2 | b) & mask;
+		if(++n >= kmerSize && isSampled(kmer))
+			seqKeys.push_back(static_cast<key_t>(j / regionSize) << 2 * kmerSize | kmer);
+	}
+	std::sort(seqKeys.begin(), seqKeys.end());
+	seqKeys.erase(std::unique(seqKeys.begin(), seqKeys.end()), seqKeys.end());
+	return seqKeys;
+}
+
+void SeedIndex::build(const PTUnrooted& ptu) {
+	csLen = ptu.numAlignSites();
+	nNodes = ptu.numNodes();
+
+	/* collect keys of every node, except the root */
+	vector<pair<key_t, uint32_t> > entries;
+	for(long i = 0; i < nNodes; ++i) {
+		const PTUnrooted::PTUNodePtr& node = ptu.getNode(i);
+		if(node->isRoot())
+			continue;
+		const vector<key_t>& nodeKeys = getKeys(node->getSeq(), 0, csLen - 1);
+		for(vector<key_t>::const_iterator key = nodeKeys.begin(); key != nodeKeys.end(); ++key)
+			entries.push_back(std::make_pair(*key, static_cast<uint32_t>(i)));
+	}
+	std::sort(entries.begin(), entries.end());
+
+	/* build the inverted index */
+	keys.clear();
+	offsets.clear();
+	ids.clear();
+	const size_t maxFreq = static_cast<size_t>(MAX_KEY_FREQ * nNodes);
+	for(size_t i = 0; i < entries.size(); ) {
+		size_t j = i;
+		while(j < entries.size() && entries[j].first == entries[i].first)
+			++j;
+		if(j - i <= maxFreq) { /* informative key */
+			keys.push_back(entries[i].first);
+			offsets.push_back(ids.size());
+			for(size_t k = i; k < j; ++k)
+				ids.push_back(entries[k].second);
+		}
+		i = j;
+	}
+	offsets.push_back(ids.size());
+}
+
+vector<long> SeedIndex::getCandidates(const DigitalSeq& seq, int start, int end, size_t maxN) const {
+	/* collect node ids of all shared keys */
+	vector<uint32_t> hits;
+	const vector<key_t>& seqKeys = getKeys(seq, start, end);
+	for(vector<key_t>::const_iterator key = seqKeys.begin(); key != seqKeys.end(); ++key) {
+		vector<key_t>::const_iterator it = std::lower_bound(keys.begin(), keys.end(), *key);
+		if(it == keys.end() || *it != *key)
+			continue;
+		const size_t k = it - keys.begin();
+		hits.insert(hits.end(), ids.begin() + offsets[k], ids.begin() + offsets[k + 1]);
+	}
+	std::sort(hits.begin(), hits.end());
+
+	/* count shared keys of each node, stored as (-count, id) for ordering */
+	vector<pair<long, long> > counts;
+	for(size_t i = 0; i < hits.size(); ) {
+		size_t j = i;
+		while(j < hits.size() && hits[j] == hits[i])
+			++j;
+		counts.push_back(std::make_pair(-static_cast<long>(j - i), static_cast<long>(hits[i])));
+		i = j;
+	}
+	if(maxN < counts.size()) {
+		std::partial_sort(counts.begin(), counts.begin() + maxN, counts.end());
+		counts.resize(maxN);
+	}
+	else
+		std::sort(counts.begin(), counts.end());
+
+	vector<long> candidates;
+	candidates.reserve(counts.size());
+	for(vector<pair<long, long> >::const_iterator count = counts.begin(); count != counts.end(); ++count)
+		candidates.push_back(count->second);
+	return candidates;
+}
+
+ostream& SeedIndex::save(ostream& out) const {
+	out.write((const char*) &kmerSize, sizeof(int));
+	out.write((const char*) &regionSize, sizeof(int));
+	out.write((const char*) &sampleRate, sizeof(int));
+	out.write((const char*) &csLen, sizeof(int));
+	out.write((const char*) &nNodes, sizeof(long));
+	size_t nKeys = keys.size();
+	size_t nIds = ids.size();
+	out.write((const char*) &nKeys, sizeof(size_t));
+	out.write((const char*) &nIds, sizeof(size_t));
+	if(nKeys > 0) {
+		out.write((const char*) &keys[0], nKeys * sizeof(key_t));
+		out.write((const char*) &offsets[0], (nKeys + 1) * sizeof(uint32_t));
+	}
+	if(nIds > 0)
+		out.write((const char*) &ids[0], nIds * sizeof(uint32_t));
+	return out;
+}
+
+istream& SeedIndex::load(istream& in) {
+	in.read((char*) &kmerSize, sizeof(int));
+	in.read((char*) &regionSize, sizeof(int));
+	in.read((char*) &sampleRate, sizeof(int));
+	in.read((char*) &csLen, sizeof(int));
+	in.read((char*) &nNodes, sizeof(long));
+	size_t nKeys, nIds;
+	in.read((char*) &nKeys, sizeof(size_t));
+	in.read((char*) &nIds, sizeof(size_t));
+	if(!in || !(0 < kmerSize && kmerSize <= MAX_KMER_SIZE && regionSize > 0 && sampleRate > 0)) {
+		in.setstate(std::ios_base::badbit);
+		return in;
+	}
+	keys.resize(nKeys);
+	offsets.resize(nKeys + 1);
+	ids.resize(nIds);
+	if(nKeys > 0) {
+		in.read((char*) &keys[0], nKeys * sizeof(key_t));
+		in.read((char*) &offsets[0], (nKeys + 1) * sizeof(uint32_t));
+	}
+	if(nIds > 0)
+		in.read((char*) &ids[0], nIds * sizeof(uint32_t));
+	/* check the stored node ids */
+	if(!in || offsets.back() != nIds) {
+		in.setstate(std::ios_base::badbit);
+		return in;
+	}
+	for(vector<uint32_t>::const_iterator id = ids.begin(); id != ids.end(); ++id) {
+		if(!(*id < nNodes)) {
+			in.setstate(std::ios_base::badbit);
+			return in;
+		}
+	}
+	return in;
+}
+
+} /* namespace HmmUFOtu */
+} /* namespace EGriceLab */
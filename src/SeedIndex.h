@@ -0,0 +1,154 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * SeedIndex.h
+ *  A windowed k-mer inverted index over the seqs of all nodes of a PTUnrooted tree,
+ *  for retrieving candidate seed nodes of a read without scanning the whole tree
+ *  The CS is divided into regions of fixed size, and every sampled k-mer of the non-gap bases
+ *  is keyed by the region of its last base, so only homologous k-mers are matched between aligned seqs
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#ifndef SRC_SEEDINDEX_H_
+#define SRC_SEEDINDEX_H_
+
+#include <vector>
+#include <iostream>
+#include <stdint.h>
+#include "DigitalSeq.h"
+#include "PhyloTreeUnrooted.h"
+
+namespace EGriceLab {
+namespace HmmUFOtu {
+
+using std::vector;
+using std::istream;
+using std::ostream;
+
+class SeedIndex {
+public:
+	typedef uint64_t key_t;
+
+	/* constructors */
+	/** construct an empty SeedIndex with given parameters */
+	explicit SeedIndex(int kmerSize = DEFAULT_KMER_SIZE, int regionSize = DEFAULT_REGION_SIZE,
+			int sampleRate = DEFAULT_SAMPLE_RATE) :
+			kmerSize(kmerSize), regionSize(regionSize), sampleRate(sampleRate), csLen(0), nNodes(0)
+	{ }
+
+	/* member methods */
+	/** test whether this index is empty */
+	bool empty() const {
+		return keys.empty();
+	}
+
+	/** get k-mer size */
+	int getKmerSize() const {
+		return kmerSize;
+	}
+
+	/** get region size */
+	int getRegionSize() const {
+		return regionSize;
+	}
+
+	/** get the CS length of the indexed tree */
+	int getCSLen() const {
+		return csLen;
+	}
+
+	/** get the number of nodes of the indexed tree */
+	long numNodes() const {
+		return nNodes;
+	}
+
+	/**
+	 * test whether this index matches a given tree by its CS length and number of nodes,
+	 * an index of another tree may return node ids out of range
+	 */
+	bool isCompatible(const PTUnrooted& ptu) const {
+		return csLen == ptu.numAlignSites() && nNodes == static_cast<long>(ptu.numNodes());
+	}
+
+	/** get number of indexed keys */
+	size_t numKeys() const {
+		return keys.size();
+	}
+
+	/** get number of indexed node entries */
+	size_t numEntries() const {
+		return ids.size();
+	}
+
+	/**
+	 * build this index from the seqs of all nodes of a tree
+	 * keys shared by more than MAX_KEY_FREQ of all nodes are not informative and dropped
+	 */
+	void build(const PTUnrooted& ptu);
+
+	/**
+	 * get up to maxN candidate node ids sharing the most indexed keys with a seq in region [start, end]
+	 * @param seq  aligned seq
+	 * @param start  0-based start
+	 * @param end  0-based end
+	 * @param maxN  maximum number of candidates
+	 * @return  candidate node ids ordered by decreasing number of shared keys
+	 */
+	vector<long> getCandidates(const DigitalSeq& seq, int start, int end, size_t maxN) const;
+
+	/** save this index to a binary output */
+	ostream& save(ostream& out) const;
+
+	/** load this index from a binary input, the stream is set bad if any stored node id is out of range */
+	istream& load(istream& in);
+
+private:
+	/** get the sorted unique keys of a seq in region [start, end] */
+	vector<key_t> getKeys(const DigitalSeq& seq, int start, int end) const;
+
+	/** test whether a k-mer is sampled */
+	bool isSampled(key_t kmer) const {
+		return (kmer * HASH_MULTIPLIER >> 32) % sampleRate == 0;
+	}
+
+	int kmerSize;
+	int regionSize;
+	int sampleRate; /* sample 1 / sampleRate of all k-mers by their hash */
+	int csLen;
+	long nNodes;
+	vector<key_t> keys; /* sorted unique keys, as region << 2 * kmerSize | kmer */
+	vector<uint32_t> offsets; /* start of node ids of each key */
+	vector<uint32_t> ids; /* node ids of all keys */
+
+public:
+	static const int DEFAULT_KMER_SIZE = 8;
+	static const int MAX_KMER_SIZE = 16;
+	static const int DEFAULT_REGION_SIZE = 100;
+	static const int DEFAULT_SAMPLE_RATE = 2;
+	static const int CANDIDATE_FACTOR = 4; /* number of candidates retrieved per requested seed */
+	static const double MAX_KEY_FREQ;
+	static const key_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+};
+
+} /* namespace HmmUFOtu */
+} /* namespace EGriceLab */
+
+#endif /* SRC_SEEDINDEX_H_ */
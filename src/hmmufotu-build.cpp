@@ -60,6 +60,7 @@ static const int DEFAULT_DG_CATEGORY = 4;
 static const int MIN_DG_CATEGORY = 2;
 static const int MAX_DG_CATEGORY = 8;
 static const int DEFAULT_NUM_THREADS = 1;
+static const string DEFAULT_SA_IDX_TYPE = "rrr";
 
 /**
  * Print introduction of this program
@@ -91,6 +92,10 @@ void printUsage(const string& progName) {
 		 << "            --no-hmm FLAG        : do not build the Hmm profile. Users should build the Hmm profile by 3rd party programs, i.e. HMMER3" << endl
 		 << "            -V|--var FLAG        : enable among-site rate varation evaluation of the tree, using a Discrete Gamma Distribution based model" << endl
 		 << "            -k INT               : number of Discrete Gamma Distribution categories to evaluate the tree, ignored if -V not set [" << DEFAULT_DG_CATEGORY << "]" << endl
+		 << "            --single FLAG        : store the cached tree likelihoods in single precision, halving the tree size on disk and in memory" << endl
+		 << "            --quantize FLAG      : store the cached tree likelihoods 16-bit log-quantized on disk (max relative error ~0.07%), decoded to single precision when loaded; implies --single" << endl
+		 << "            --sa-rate INT        : sample rate of the suffix-array in CSFM-index, smaller values use more memory but give faster seed locating [" << CSFMIndex::DEFAULT_SA_SAMPLE_RATE << "]" << endl
+		 << "            --sa-idx STR         : index type of sampled suffix-array positions, either 'rrr' (compressed) or 'rg' (plain bitmap, larger but faster) [" << DEFAULT_SA_IDX_TYPE << "]" << endl
 #ifdef _OPENMP
 		 << "            -p|--process INT     : number of threads/cpus used for parallel processing" << endl
 #endif
@@ -104,7 +109,7 @@ int main(int argc, char* argv[]) {
 	string seqFn, treeFn, dbName, annoFn;
 	ifstream dmIn, smIn, treeIn, annoIn;
 	boost::iostreams::filtering_istream seqIn;
-	ofstream msaOut, csfmOut, hmmOut, ptuOut;
+	ofstream msaOut, csfmOut, hmmOut, ptuOut, sidxOut;
 	string fmt;
 	string rootName = PhyloTreeUnrooted::DEFAULT_ROOT_NAME;
 	string smType = DEFAULT_SM_TYPE;
@@ -113,7 +118,11 @@ int main(int argc, char* argv[]) {
 	string smFn;
 	bool noHmm = false;
 	bool isVar = false;
+	bool singlePrec = false;
+	bool quantized = false;
 	int K = DEFAULT_DG_CATEGORY;
+	int saRate = CSFMIndex::DEFAULT_SA_SAMPLE_RATE;
+	string saIdx = DEFAULT_SA_IDX_TYPE;
 	int nThreads = DEFAULT_NUM_THREADS;
 
 	/* parse options */
@@ -182,9 +191,21 @@ int main(int argc, char* argv[]) {
 	if(cmdOpts.hasOpt("--no-hmm"))
 		noHmm = true;
 
+	if(cmdOpts.hasOpt("--single"))
+		singlePrec = true;
+
+	if(cmdOpts.hasOpt("--quantize"))
+		singlePrec = quantized = true;
+
 	if(cmdOpts.hasOpt("-k"))
 		K = atoi(cmdOpts.getOptStr("-k"));
 
+	if(cmdOpts.hasOpt("--sa-rate"))
+		saRate = atoi(cmdOpts.getOptStr("--sa-rate"));
+
+	if(cmdOpts.hasOpt("--sa-idx"))
+		saIdx = cmdOpts.getOpt("--sa-idx");
+
 #ifdef _OPENMP
 	if(cmdOpts.hasOpt("-p"))
 		nThreads = ::atoi(cmdOpts.getOptStr("-p"));
@@ -218,6 +239,16 @@ int main(int argc, char* argv[]) {
 		return EXIT_FAILURE;
 	}
 
+	if(!(0 < saRate && saRate <= CSFMIndex::MAX_SA_SAMPLE_RATE)) {
+		cerr << "--sa-rate must be an integer between 1 and " << CSFMIndex::MAX_SA_SAMPLE_RATE << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(!(saIdx == "rrr" || saIdx == "rg")) {
+		cerr << "--sa-idx must be either 'rrr' or 'rg'" << endl;
+		return EXIT_FAILURE;
+	}
+
 	if(!(symfrac >= 0 && symfrac <= 1)) {
 		cerr << "-f|--symfrac must between 0 and 1" << endl;
 		return EXIT_FAILURE;
@@ -281,6 +312,7 @@ int main(int argc, char* argv[]) {
 	string csfmFn = dbName + CSFM_FILE_SUFFIX;
 	string hmmFn = dbName + HMM_FILE_SUFFIX;
 	string ptuFn = dbName + PHYLOTREE_FILE_SUFFIX;
+	string sidxFn = dbName + SEED_INDEX_FILE_SUFFIX;
 
 	/* open output files */
 	msaOut.open(msaFn.c_str(), ios_base::out | ios_base::binary);
@@ -303,6 +335,11 @@ int main(int argc, char* argv[]) {
 		cerr << "Unable to write to '" << ptuFn << "': " << ::strerror(errno) << endl;
 		return EXIT_FAILURE;
 	}
+	sidxOut.open(sidxFn.c_str(), ios_base::out | ios_base::binary);
+	if(!sidxOut.is_open()) {
+		cerr << "Unable to write to '" << sidxFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
 
 	/* build msa */
 	MSA msa;
@@ -319,9 +356,9 @@ int main(int argc, char* argv[]) {
 
 	/* build csfm */
 	CSFMIndex csfm;
-	csfm.build(msa);
+	csfm.build(msa, saRate, saIdx == "rg" ? CSFMIndex::RG : CSFMIndex::RRR);
 	if(csfm.isInitiated())
-		infoLog << "CSFM index built" << endl;
+		infoLog << "CSFM index built" << (csfm.is64() ? " with 64-bit suffix-array" : "") << endl;
 	else {
 		cerr << "Unable to build CSFM index" << endl;
 		return EXIT_FAILURE;
@@ -366,7 +403,8 @@ int main(int argc, char* argv[]) {
 		return EXIT_FAILURE;
 	}
 	else
-		infoLog << "MSA loaded into Phylogenetic Tree" << endl;
+		infoLog << "MSA loaded into Phylogenetic Tree, " << tree.numAlignSites() << " aligned sites compressed into "
+				<< tree.numSitePatterns() << " site patterns" << endl;
 	if(annoIn.is_open()) {
 		tree.loadAnnotation(annoIn);
 		if(annoIn.bad()) {
@@ -411,6 +449,7 @@ int main(int argc, char* argv[]) {
 	tree.setModel(model);
 
 	/* initiation the tree costs */
+	debugLog << "Using " << LikKernel::simdName() << " likelihood kernels" << endl;
 	tree.initRootLoglik();
 	tree.initBranchLoglik();
 	tree.initLeafMat();
@@ -449,14 +488,8 @@ int main(int argc, char* argv[]) {
 	else
 		infoLog << "Re-evaluating Phylogenetic Tree at all " << tree.numNodes() << " nodes" << endl;
 
-	const size_t numNodes = tree.numNodes();
-	for(size_t i = 0; i < numNodes; ++i) {
-		debugLog << "Evaluating root at node " << i << endl;
-		tree.setRoot(i);
-		tree.evaluate();
-	}
-	/* reset to original root, and evaluate its root Loglik */
-	tree.setRoot(root);
+	tree.evaluateAll();
+	/* evaluate the root Loglik at the original root */
 	tree.updateRootLoglik();
 	infoLog << "Final Tree log-liklihood: " << tree.treeLoglik() << endl;
 
@@ -464,6 +497,12 @@ int main(int argc, char* argv[]) {
 	tree.inferSeq();
 	infoLog << "Ancestor sequence of all intermediate nodes inferred" << endl;
 
+	/* build the seed index of all node seqs */
+	SeedIndex sidx;
+	sidx.build(tree);
+	infoLog << "Seed index built with " << sidx.numKeys() << " " << sidx.getKmerSize() << "-mer keys and "
+			<< sidx.numEntries() << " entries" << endl;
+
 	infoLog << "Saving database files ..." << endl;
 	/* write database files, all with prepend program info */
 	saveProgInfo(msaOut);
@@ -491,6 +530,14 @@ int main(int argc, char* argv[]) {
 		infoLog << "Banded HMM profile saved" << endl;
 	}
 
+	if(singlePrec) {
+		tree.setSinglePrec(true);
+		infoLog << "Tree likelihoods converted to single precision" << endl;
+	}
+	if(quantized) {
+		tree.setQuantized(true);
+		infoLog << "Tree likelihoods will be saved 16-bit log-quantized" << endl;
+	}
 	saveProgInfo(ptuOut);
 	tree.save(ptuOut);
 	if(ptuOut.bad()) {
@@ -498,4 +545,12 @@ int main(int argc, char* argv[]) {
 		return EXIT_FAILURE;
 	}
 	infoLog << "Phylogenetic Tree index saved" << endl;
+
+	saveProgInfo(sidxOut);
+	sidx.save(sidxOut);
+	if(sidxOut.bad()) {
+		cerr << "Unable to save Seed index: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "Seed index saved" << endl;
 }
@@ -205,7 +205,11 @@ int main(int argc, char* argv[]) {
 		return EXIT_FAILURE;
 	}
 	cout << "CSFM-index loaded. Version: " << pver <<
-			" Concatenated length: " << csfm.getConcatLen() << " CS length: " << csfm.getCSLen() << endl;
+			" Concatenated length: " << csfm.getConcatLen() << " CS length: " << csfm.getCSLen() <<
+			" SA sample rate: " << csfm.getSASampleRate() <<
+			" SA index: " << (csfm.getSAIdxType() == CSFMIndex::RG ? "rg" : "rrr") <<
+			" SA width: " << (csfm.is64() ? 64 : 32) << "-bit" <<
+			" CS index width: " << (csfm.isWideCS() ? 32 : 16) << "-bit" << endl;
 	if(csfm.getCSLen() != csLen) {
 		cerr << "Error: Unmatched CS length between CSFM-index and MSA data" << endl;
 		return EXIT_FAILURE;
@@ -241,8 +245,10 @@ int main(int argc, char* argv[]) {
 		 << " # of leaves: " << ptu.numLeaves()
 		 << " # of nodes: " << ptu.numNodes()
 		 << " # of branches: " << ptu.numBranches()
-		 << " # of sites: " << ptu.numAlignSites() << endl;
+		 << " # of sites: " << ptu.numAlignSites()
+		 << " # of site patterns: " << ptu.numSitePatterns() << endl;
 	cout << "Overall tree log-likelihood: " << ptu.treeLoglik() << endl;
+	cout << "Cached likelihood precision: " << (ptu.isSinglePrec() ? "single" : "double") << endl;
 
 	if(showSm)
 		cout << (*ptu.getModel());
@@ -0,0 +1,444 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * hmmufotu-slice.cpp
+ * Slice a hmmufotu database to a region of the CS, i.e. an amplicon region
+ * The sliced database includes a msa file, an hmm file, a csfm file, a ptu file and a sidx file restricted to that region
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <cerrno>
+#include <boost/lexical_cast.hpp>
+#include "HmmUFOtu.h"
+
+#ifndef SRC_DATADIR
+#define SRC_DATADIR "."
+#endif
+
+#ifndef PKG_DATADIR
+#define PKG_DATADIR "."
+#endif
+
+using namespace std;
+using namespace EGriceLab;
+using namespace EGriceLab::HmmUFOtu;
+
+/** default values */
+static const double DEFAULT_SYMFRAC = 0.5;
+static const string DEFAULT_DM_FILE = "gg_97_otus.dm";
+static const int DEFAULT_PRIMER_MISMATCH = 0;
+static const string DEFAULT_SA_IDX_TYPE = "rrr";
+
+/**
+ * Print introduction of this program
+ */
+void printIntro(void) {
+	cerr << "Slice an HmmUFOtu database to a region of the consensus sequence (CS), i.e. the amplicon region of a primer pair" << endl;
+}
+
+/**
+ * Print the usage information
+ */
+void printUsage(const string& progName) {
+	cerr << "Usage:    " << progName << "  <DBNAME> <-r START-END | --fwd-primer STR --rev-primer STR> [options]" << endl
+		 << "DBNAME  STR                      : HmmUFOtu database name (prefix)" << endl
+		 << "-r|--region  START-END           : 1-based CS region to keep" << endl
+		 << "--fwd-primer  STR                : forward primer in 5'->3' direction, IUPAC codes allowed, used to locate the region start if -r is not given" << endl
+		 << "--rev-primer  STR                : reverse primer in 5'->3' direction, IUPAC codes allowed, used to locate the region end if -r is not given" << endl
+		 << "Options:    -o|--out  STR        : name (prefix) of the sliced database [DBNAME_START-END]" << endl
+		 << "            --primer-mismatch INT: max mismatches allowed when locating the primers on the reference sequences [" << DEFAULT_PRIMER_MISMATCH << "]" << endl
+		 << "            -f|--symfrac  DOUBLE : conservation threshold for considering a site as a Match state in the sliced HMM [" << DEFAULT_SYMFRAC << "]" << endl
+		 << "            -dm  FILE            : use customized trained Dirichlet Model in FILE instead of the build-in file" << endl
+		 << "            --sa-rate INT        : sample rate of the suffix-array in the sliced CSFM-index [" << CSFMIndex::DEFAULT_SA_SAMPLE_RATE << "]" << endl
+		 << "            --sa-idx STR         : index type of sampled suffix-array positions, either 'rrr' (compressed) or 'rg' (plain bitmap, larger but faster) [" << DEFAULT_SA_IDX_TYPE << "]" << endl
+		 << "            -v  FLAG             : enable verbose information, you may set multiple -v for more details" << endl
+		 << "            --version            : show program version and exit" << endl
+		 << "            -h|--help            : print this message and exit" << endl;
+}
+
+/**
+ * locate a primer on the CS by matching it to every sequence of a MSA, allowing degenerate bases and mismatches
+ * @param msa  MSA of the database
+ * @param primer  primer seq to match on the forward strand
+ * @param maxMismatch  max mismatches allowed
+ * @param fromEnd  locate the last match of each sequence and return its end, instead of the first match and its start
+ * @param nFound  number of sequences matched
+ * @return  the most frequent 0-based CS position of the matches, or -1 if not found in any sequence
+ */
+static int locatePrimer(const MSA& msa, const string& primer, int maxMismatch, bool fromEnd, unsigned& nFound);
+
+int main(int argc, char* argv[]) {
+	/* variable declarations */
+	string dbName, outName;
+	string msaFn, ptuFn;
+	string fwdPrimer, revPrimer;
+	ifstream msaIn, ptuIn, dmIn;
+	ofstream msaOut, csfmOut, hmmOut, ptuOut, sidxOut;
+	int csStart = 0; /* 1-based */
+	int csEnd = 0; /* 1-based */
+	int maxMismatch = DEFAULT_PRIMER_MISMATCH;
+	double symfrac = DEFAULT_SYMFRAC;
+	string dmFn;
+	int saRate = CSFMIndex::DEFAULT_SA_SAMPLE_RATE;
+	string saIdx = DEFAULT_SA_IDX_TYPE;
+
+	/* parse options */
+	CommandOptions cmdOpts(argc, argv);
+	if(cmdOpts.empty() || cmdOpts.hasOpt("-h") || cmdOpts.hasOpt("--help")) {
+		printIntro();
+		printUsage(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	if(cmdOpts.hasOpt("--version")) {
+		printVersion(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	if(cmdOpts.numMainOpts() != 1) {
+		cerr << "Error:" << endl;
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	dbName = cmdOpts.getMainOpt(0);
+
+	string region;
+	if(cmdOpts.hasOpt("-r"))
+		region = cmdOpts.getOpt("-r");
+	if(cmdOpts.hasOpt("--region"))
+		region = cmdOpts.getOpt("--region");
+
+	if(cmdOpts.hasOpt("--fwd-primer"))
+		fwdPrimer = cmdOpts.getOpt("--fwd-primer");
+	if(cmdOpts.hasOpt("--rev-primer"))
+		revPrimer = cmdOpts.getOpt("--rev-primer");
+
+	if(cmdOpts.hasOpt("--primer-mismatch"))
+		maxMismatch = ::atoi(cmdOpts.getOptStr("--primer-mismatch"));
+
+	if(cmdOpts.hasOpt("-o"))
+		outName = cmdOpts.getOpt("-o");
+	if(cmdOpts.hasOpt("--out"))
+		outName = cmdOpts.getOpt("--out");
+
+	if(cmdOpts.hasOpt("-f"))
+		symfrac = ::atof(cmdOpts.getOptStr("-f"));
+	if(cmdOpts.hasOpt("--symfrac"))
+		symfrac = ::atof(cmdOpts.getOptStr("--symfrac"));
+
+	dmFn = PKG_DATADIR + string("/") + DEFAULT_DM_FILE;
+	if(!ifstream(dmFn.c_str()).good())
+		dmFn = SRC_DATADIR + string("/") + DEFAULT_DM_FILE;
+	if(cmdOpts.hasOpt("-dm"))
+		dmFn = cmdOpts.getOpt("-dm");
+
+	if(cmdOpts.hasOpt("--sa-rate"))
+		saRate = ::atoi(cmdOpts.getOptStr("--sa-rate"));
+
+	if(cmdOpts.hasOpt("--sa-idx"))
+		saIdx = cmdOpts.getOpt("--sa-idx");
+
+	if(cmdOpts.hasOpt("-v"))
+		INCREASE_LEVEL(cmdOpts.getOpt("-v").length());
+
+	/* check options */
+	if(!region.empty()) {
+		if(::sscanf(region.c_str(), "%d-%d", &csStart, &csEnd) != 2 || !(0 < csStart && csStart <= csEnd)) {
+			cerr << "-r|--region must be in START-END format with 0 < START <= END" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	else if(fwdPrimer.empty() || revPrimer.empty()) {
+		cerr << "Either -r|--region or both --fwd-primer and --rev-primer must be given" << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(!(maxMismatch >= 0)) {
+		cerr << "--primer-mismatch must be non-negative" << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(!(symfrac >= 0 && symfrac <= 1)) {
+		cerr << "-f|--symfrac must between 0 and 1" << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(!(0 < saRate && saRate <= CSFMIndex::MAX_SA_SAMPLE_RATE)) {
+		cerr << "--sa-rate must be an integer between 1 and " << CSFMIndex::MAX_SA_SAMPLE_RATE << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(!(saIdx == "rrr" || saIdx == "rg")) {
+		cerr << "--sa-idx must be either 'rrr' or 'rg'" << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* open inputs */
+	msaFn = dbName + MSA_FILE_SUFFIX;
+	ptuFn = dbName + PHYLOTREE_FILE_SUFFIX;
+
+	msaIn.open(msaFn.c_str(), ios_base::in | ios_base::binary);
+	if(!msaIn) {
+		cerr << "Unable to open MSA data '" << msaFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	ptuIn.open(ptuFn.c_str(), ios_base::in | ios_base::binary);
+	if(!ptuIn) {
+		cerr << "Unable to open PTU data '" << ptuFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	dmIn.open(dmFn.c_str());
+	if(!dmIn.is_open()) {
+		cerr << "Unable to open '" << dmFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* load MSA and determine the region */
+	if(loadProgInfo(msaIn).bad())
+		return EXIT_FAILURE;
+	MSA msa;
+	msa.load(msaIn);
+	if(msaIn.bad()) {
+		cerr << "Failed to load MSA data '" << msaFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	const int csLen = msa.getCSLen();
+	infoLog << "MSA loaded" << endl;
+
+	if(region.empty()) {
+		unsigned nFwd = 0, nRev = 0;
+		int start = locatePrimer(msa, fwdPrimer, maxMismatch, false, nFwd);
+		int end = locatePrimer(msa, PrimarySeq(msa.getAbc(), "rev", revPrimer).revcom().getSeq(), maxMismatch, true, nRev);
+		if(start == -1 || end == -1) {
+			cerr << "Unable to locate the " << (start == -1 ? "forward" : "reverse") << " primer on any reference sequence" << endl;
+			return EXIT_FAILURE;
+		}
+		infoLog << "Forward primer located at CS position " << (start + 1) << " on " << nFwd << " reference sequences" << endl;
+		infoLog << "Reverse primer located at CS position " << (end + 1) << " on " << nRev << " reference sequences" << endl;
+		if(!(start <= end)) {
+			cerr << "Located forward primer is found after the reverse primer, please check the primer sequences" << endl;
+			return EXIT_FAILURE;
+		}
+		csStart = start + 1;
+		csEnd = end + 1;
+	}
+	if(!(csEnd <= csLen)) {
+		cerr << "Region " << csStart << "-" << csEnd << " exceeds the CS length " << csLen << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* set outName */
+	if(outName.empty())
+		outName = dbName + "_" + boost::lexical_cast<string>(csStart) + "-" + boost::lexical_cast<string>(csEnd);
+	if(outName == dbName) {
+		cerr << "Sliced database name must be different from the original database" << endl;
+		return EXIT_FAILURE;
+	}
+
+	string msaOutFn = outName + MSA_FILE_SUFFIX;
+	string csfmOutFn = outName + CSFM_FILE_SUFFIX;
+	string hmmOutFn = outName + HMM_FILE_SUFFIX;
+	string ptuOutFn = outName + PHYLOTREE_FILE_SUFFIX;
+	string sidxOutFn = outName + SEED_INDEX_FILE_SUFFIX;
+
+	/* open output files */
+	msaOut.open(msaOutFn.c_str(), ios_base::out | ios_base::binary);
+	if(!msaOut.is_open()) {
+		cerr << "Unable to write to '" << msaOutFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	csfmOut.open(csfmOutFn.c_str(), ios_base::out | ios_base::binary);
+	if(!csfmOut.is_open()) {
+		cerr << "Unable to write to '" << csfmOutFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	hmmOut.open(hmmOutFn.c_str());
+	if(!hmmOut.is_open()) {
+		cerr << "Unable to write to '" << hmmOutFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	ptuOut.open(ptuOutFn.c_str(), ios_base::out | ios_base::binary);
+	if(!ptuOut.is_open()) {
+		cerr << "Unable to write to '" << ptuOutFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	sidxOut.open(sidxOutFn.c_str(), ios_base::out | ios_base::binary);
+	if(!sidxOut.is_open()) {
+		cerr << "Unable to write to '" << sidxOutFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* slice msa */
+	msa.slice(csStart - 1, csEnd - 1);
+	msa.setName(outName);
+	infoLog << "MSA sliced to CS region " << csStart << "-" << csEnd << " with " << msa.getNumSeq() << " X " << msa.getCSLen() << " aligned sequences" << endl;
+
+	/* build csfm on the sliced sequences */
+	CSFMIndex csfm;
+	csfm.build(msa, saRate, saIdx == "rg" ? CSFMIndex::RG : CSFMIndex::RRR);
+	if(csfm.isInitiated())
+		infoLog << "CSFM index built" << (csfm.is64() ? " with 64-bit suffix-array" : "") << endl;
+	else {
+		cerr << "Unable to build CSFM index" << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* train the HMM sub-profile on the sliced MSA */
+	BandedHMMP7Prior hmmPrior;
+	dmIn >> hmmPrior;
+	if(dmIn.bad()) {
+		cerr << "Failed to read in the HMM Prior file '" << dmFn << "'" << endl;
+		return EXIT_FAILURE;
+	}
+	BandedHMMP7 hmm;
+	hmm.setName(outName);
+	hmm.setHmmVersion(getProgFullName(progName, progVer));
+	hmm.build(msa, symfrac, hmmPrior);
+	infoLog << "Banded HMM profile trained with " << hmm.getProfileSize() << " match states" << endl;
+
+	/* slice ptu, the branch arena is read in so it can be modified */
+	if(loadProgInfo(ptuIn).bad())
+		return EXIT_FAILURE;
+	PTUnrooted ptu;
+	ptu.load(ptuIn);
+	if(ptuIn.bad()) {
+		cerr << "Unable to load Phylogenetic tree data '" << ptuFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "Phylogenetic tree loaded" << endl;
+	if(ptu.numAlignSites() != csLen) {
+		cerr << "Error: Unmatched alignment length between Phylogenetic tree and MSA data" << endl;
+		return EXIT_FAILURE;
+	}
+	ptu.slice(csStart - 1, csEnd - 1);
+	infoLog << "Phylogenetic tree sliced, " << ptu.numAlignSites() << " aligned sites compressed into "
+			<< ptu.numSitePatterns() << " site patterns" << endl;
+
+	/* rebuild the seed index of the sliced node seqs */
+	SeedIndex sidx;
+	sidx.build(ptu);
+	infoLog << "Seed index built with " << sidx.numKeys() << " " << sidx.getKmerSize() << "-mer keys and "
+			<< sidx.numEntries() << " entries" << endl;
+
+	infoLog << "Saving database files ..." << endl;
+	/* write database files, all with prepend program info */
+	saveProgInfo(msaOut);
+	msa.save(msaOut);
+	if(msaOut.bad()) {
+		cerr << "Unable to save MSA: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "MSA saved" << endl;
+
+	saveProgInfo(csfmOut);
+	csfm.save(csfmOut);
+	if(csfmOut.bad()) {
+		cerr << "Unable to save CSFM index: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "CSFM saved" << endl;
+
+	hmmOut << hmm;
+	if(hmmOut.bad()) {
+		cerr << "Unable to save HMM profile: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "Banded HMM profile saved" << endl;
+
+	saveProgInfo(ptuOut);
+	ptu.save(ptuOut);
+	if(ptuOut.bad()) {
+		cerr << "Unable to save Phylogenetic Tree index: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "Phylogenetic Tree index saved" << endl;
+
+	saveProgInfo(sidxOut);
+	sidx.save(sidxOut);
+	if(sidxOut.bad()) {
+		cerr << "Unable to save Seed index: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "Seed index saved" << endl;
+}
+
+int locatePrimer(const MSA& msa, const string& primer, int maxMismatch, bool fromEnd, unsigned& nFound) {
+	const DegenAlphabet* abc = msa.getAbc();
+	const int L = primer.length();
+	const int csLen = msa.getCSLen();
+	/* allowed base codes of each primer position */
+	vector<unsigned> primerMask(L);
+	for(int p = 0; p < L; ++p)
+		for(int8_t b = 0; b < abc->getSize(); ++b)
+			if(abc->isMatch(::toupper(primer[p]), b))
+				primerMask[p] |= 1U << b;
+
+	map<int, unsigned> loc2count;
+	nFound = 0;
+	vector<int8_t> bases;
+	vector<int> locs;
+	for(unsigned i = 0; i < msa.getNumSeq(); ++i) {
+		/* get the unaligned seq and its CS positions */
+		bases.clear();
+		locs.clear();
+		for(int j = 0; j < csLen; ++j) {
+			int8_t b = msa.encodeAt(i, j);
+			if(b >= 0) {
+				bases.push_back(b);
+				locs.push_back(j);
+			}
+		}
+		const int N = bases.size();
+		for(int k = 0; k + L <= N; ++k) {
+			int from = fromEnd ? N - L - k : k;
+			int nMismatch = 0;
+			for(int p = 0; p < L && nMismatch <= maxMismatch; ++p)
+				if(!(primerMask[p] & (1U << bases[from + p])))
+					nMismatch++;
+			if(nMismatch <= maxMismatch) {
+				loc2count[fromEnd ? locs[from + L - 1] : locs[from]]++;
+				nFound++;
+				break;
+			}
+		}
+	}
+
+	int bestLoc = -1;
+	unsigned bestCount = 0;
+	for(map<int, unsigned>::const_iterator it = loc2count.begin(); it != loc2count.end(); ++it) {
+		if(it->second > bestCount) {
+			bestLoc = it->first;
+			bestCount = it->second;
+		}
+	}
+	return bestLoc;
+}
@@ -0,0 +1,515 @@
+/*******************************************************************************
+ * This file is part of HmmUFOtu, an HMM and Phylogenetic placement
+ * based tool for Ultra-fast taxonomy assignment and OTU organization
+ * of microbiome sequencing data with species level accuracy.
+ * Copyright (C) 2017  Qi Zheng
+ *
+ * HmmUFOtu is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HmmUFOtu is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with AlignerBoost.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+/*
+ * hmmufotu-update.cpp
+ * Update a hmmufotu database with new reference sequences without a full rebuild
+ * New sequences are aligned with the database HMM and grafted onto the tree at their best placements,
+ * then only the affected tree branches are re-evaluated
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/iostreams/filtering_stream.hpp> /* basic boost streams */
+#include <boost/iostreams/device/file.hpp> /* file sink and source */
+#include <boost/iostreams/filter/zlib.hpp> /* for zlib support */
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/bzip2.hpp> /* for bzip2 support */
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "HmmUFOtu.h"
+#include "HmmUFOtu_main.h"
+
+using namespace std;
+using namespace EGriceLab;
+using namespace EGriceLab::HmmUFOtu;
+
+/** default values */
+static const int DEFAULT_SEED_LEN = 20;
+static const int DEFAULT_SEED_REGION = 50;
+static const int DEFAULT_SEED_MISMATCH = 1;
+static const size_t DEFAULT_MAX_NSEED = 50;
+static const double DEFAULT_MAX_PLACE_ERROR = 20;
+static const string DEFAULT_BRANCH_EST_METHOD = "unweighted";
+static const int DEFAULT_NUM_THREADS = 1;
+static const string DEFAULT_SA_IDX_TYPE = "rrr";
+
+/**
+ * Print introduction of this program
+ */
+void printIntro(void) {
+	cerr << "Update an HmmUFOtu database with new reference sequences, by placing them onto the existing phylogenetic tree without a full rebuild" << endl;
+}
+
+/**
+ * Print the usage information
+ */
+void printUsage(const string& progName) {
+	string ZLIB_SUPPORT;
+	#ifdef HAVE_LIBZ
+	ZLIB_SUPPORT = ", support .gz or .bz2 compressed file";
+	#endif
+
+	cerr << "Usage:    " << progName << "  <DBNAME> <SEQ-FILE> [options]" << endl
+		 << "DBNAME  STR                      : HmmUFOtu database name (prefix)" << endl
+		 << "SEQ-FILE  FILE                   : new reference sequences, aligned or not" << ZLIB_SUPPORT << endl
+		 << "Options:    -o|--out  STR        : name (prefix) of the updated database, use DBNAME to update in place [DBNAME]" << endl
+		 << "            --fmt  STR           : sequence format, 'fasta' or 'fastq', guessed by the file name by default" << endl
+		 << "            -a|--anno  FILE      : use tab-delimited taxonamy annotation file for the new sequences" << endl
+		 << "            --sa-rate INT        : sample rate of the suffix-array in the updated CSFM-index [" << CSFMIndex::DEFAULT_SA_SAMPLE_RATE << "]" << endl
+		 << "            --sa-idx STR         : index type of sampled suffix-array positions, either 'rrr' (compressed) or 'rg' (plain bitmap, larger but faster) [" << DEFAULT_SA_IDX_TYPE << "]" << endl
+#ifdef _OPENMP
+		 << "            -p|--process INT     : number of threads/cpus used for parallel processing" << endl
+#endif
+		 << "            -v  FLAG             : enable verbose information, you may set multiple -v for more details" << endl
+		 << "            --version            : show program version and exit" << endl
+		 << "            -h|--help            : print this message and exit" << endl;
+}
+
+int main(int argc, char* argv[]) {
+	/* variable declarations */
+	string dbName, outName, seqFn, annoFn;
+	string msaFn, csfmFn, hmmFn, ptuFn;
+	ifstream msaIn, csfmIn, hmmIn, ptuIn, annoIn;
+	boost::iostreams::filtering_istream seqIn;
+	ofstream msaOut, csfmOut, hmmOut, ptuOut, sidxOut;
+	string seqFmt;
+	int saRate = CSFMIndex::DEFAULT_SA_SAMPLE_RATE;
+	string saIdx = DEFAULT_SA_IDX_TYPE;
+	int nThreads = DEFAULT_NUM_THREADS;
+
+	/* parse options */
+	CommandOptions cmdOpts(argc, argv);
+	if(cmdOpts.empty() || cmdOpts.hasOpt("-h") || cmdOpts.hasOpt("--help")) {
+		printIntro();
+		printUsage(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	if(cmdOpts.hasOpt("--version")) {
+		printVersion(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	if(cmdOpts.numMainOpts() != 2) {
+		cerr << "Error:" << endl;
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	dbName = cmdOpts.getMainOpt(0);
+	seqFn = cmdOpts.getMainOpt(1);
+
+	outName = dbName;
+	if(cmdOpts.hasOpt("-o"))
+		outName = cmdOpts.getOpt("-o");
+	if(cmdOpts.hasOpt("--out"))
+		outName = cmdOpts.getOpt("--out");
+
+	if(cmdOpts.hasOpt("--fmt"))
+		seqFmt = cmdOpts.getOpt("--fmt");
+
+	if(cmdOpts.hasOpt("-a"))
+		annoFn = cmdOpts.getOpt("-a");
+	if(cmdOpts.hasOpt("--anno"))
+		annoFn = cmdOpts.getOpt("--anno");
+
+	if(cmdOpts.hasOpt("--sa-rate"))
+		saRate = ::atoi(cmdOpts.getOptStr("--sa-rate"));
+
+	if(cmdOpts.hasOpt("--sa-idx"))
+		saIdx = cmdOpts.getOpt("--sa-idx");
+
+	if(cmdOpts.hasOpt("-p"))
+		nThreads = ::atoi(cmdOpts.getOptStr("-p"));
+	if(cmdOpts.hasOpt("--process"))
+		nThreads = ::atoi(cmdOpts.getOptStr("--process"));
+
+	if(cmdOpts.hasOpt("-v"))
+		INCREASE_LEVEL(cmdOpts.getOpt("-v").length());
+
+	/* guess input format */
+	if(seqFmt.empty()) {
+		string seqPre = seqFn;
+		StringUtils::removeEnd(seqPre, GZIP_FILE_SUFFIX);
+		StringUtils::removeEnd(seqPre, BZIP2_FILE_SUFFIX);
+		seqFmt = SeqUtils::guessSeqFileFormat(seqPre);
+	}
+	if(!(seqFmt == "fasta" || seqFmt == "fastq")) {
+		cerr << "Unsupported sequence format '" << seqFmt << "'" << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* check options */
+	if(!(0 < saRate && saRate <= CSFMIndex::MAX_SA_SAMPLE_RATE)) {
+		cerr << "--sa-rate must be an integer between 1 and " << CSFMIndex::MAX_SA_SAMPLE_RATE << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(!(saIdx == "rrr" || saIdx == "rg")) {
+		cerr << "--sa-idx must be either 'rrr' or 'rg'" << endl;
+		return EXIT_FAILURE;
+	}
+
+#ifdef _OPENMP
+	if(!(nThreads > 0)) {
+		cerr << "-p|--process must be positive" << endl;
+		return EXIT_FAILURE;
+	}
+	omp_set_num_threads(nThreads);
+#endif
+
+	/* open inputs */
+	msaFn = dbName + MSA_FILE_SUFFIX;
+	csfmFn = dbName + CSFM_FILE_SUFFIX;
+	hmmFn = dbName + HMM_FILE_SUFFIX;
+	ptuFn = dbName + PHYLOTREE_FILE_SUFFIX;
+
+	msaIn.open(msaFn.c_str(), ios_base::in | ios_base::binary);
+	if(!msaIn) {
+		cerr << "Unable to open MSA data '" << msaFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	csfmIn.open(csfmFn.c_str(), ios_base::in | ios_base::binary);
+	if(!csfmIn) {
+		cerr << "Unable to open CSFM-index '" << csfmFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	hmmIn.open(hmmFn.c_str());
+	if(!hmmIn) {
+		cerr << "Unable to open HMM profile '" << hmmFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	ptuIn.open(ptuFn.c_str(), ios_base::in | ios_base::binary);
+	if(!ptuIn) {
+		cerr << "Unable to open PTU data '" << ptuFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(!annoFn.empty()) {
+		annoIn.open(annoFn.c_str());
+		if(!annoIn.is_open()) {
+			cerr << "Unable to open annotation file '" << annoFn << "': " << ::strerror(errno) << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+#ifdef HAVE_LIBZ
+	if(StringUtils::endsWith(seqFn, GZIP_FILE_SUFFIX))
+		seqIn.push(boost::iostreams::gzip_decompressor());
+	else if(StringUtils::endsWith(seqFn, BZIP2_FILE_SUFFIX))
+		seqIn.push(boost::iostreams::bzip2_decompressor());
+	else { }
+#endif
+	/* open source */
+	seqIn.push(boost::iostreams::file_source(seqFn));
+	if(seqIn.bad()) {
+		cerr << "Unable to open seq file '" << seqFn << "' " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* loading database files */
+	if(loadProgInfo(msaIn).bad())
+		return EXIT_FAILURE;
+	MSA msa;
+	msa.load(msaIn);
+	if(msaIn.bad()) {
+		cerr << "Failed to load MSA data '" << msaFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	const int csLen = msa.getCSLen();
+	infoLog << "MSA loaded" << endl;
+
+	BandedHMMP7 hmm;
+	hmmIn >> hmm;
+	if(hmmIn.bad()) {
+		cerr << "Unable to read HMM profile '" << hmmFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "HMM profile read" << endl;
+	if(hmm.getProfileSize() > csLen) {
+		cerr << "Error: HMM profile size is found greater than the MSA CS length" << endl;
+		return EXIT_FAILURE;
+	}
+	const DegenAlphabet* abc = hmm.getNuclAbc();
+
+	if(loadProgInfo(csfmIn).bad())
+		return EXIT_FAILURE;
+	CSFMIndex csfm;
+	csfm.load(csfmIn);
+	if(csfmIn.bad()) {
+		cerr << "Failed to load CSFM-index '" << csfmFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "CSFM-index loaded" << endl;
+	if(csfm.getCSLen() != csLen) {
+		cerr << "Error: Unmatched CS length between CSFM-index and MSA data" << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* the branch arena is read in so it can be modified */
+	if(loadProgInfo(ptuIn).bad())
+		return EXIT_FAILURE;
+	PTUnrooted ptu;
+	ptu.load(ptuIn);
+	if(ptuIn.bad()) {
+		cerr << "Unable to load Phylogenetic tree data '" << ptuFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "Phylogenetic tree loaded" << endl;
+	if(ptu.numAlignSites() != csLen) {
+		cerr << "Error: Unmatched alignment length between Phylogenetic tree and MSA data" << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* read annotations of the new seqs */
+	boost::unordered_map<string, string> id2anno;
+	if(annoIn.is_open()) {
+		string line, id, anno;
+		while(std::getline(annoIn, line)) {
+			istringstream lineIn(line);
+			std::getline(lineIn, id, '\t');
+			std::getline(lineIn, anno, '\t');
+			id2anno[id] = anno;
+		}
+		if(annoIn.bad()) {
+			cerr << "Failed to read the annotation file '" << annoFn << "'" << endl;
+			return EXIT_FAILURE;
+		}
+		infoLog << "Annotation file read" << endl;
+	}
+
+	/* read new seqs, which must be new to the database */
+	boost::unordered_set<string> msaNames(msa.getSeqNames().begin(), msa.getSeqNames().end());
+	vector<PrimarySeq> seqs;
+	SeqIO seqI(dynamic_cast<istream*> (&seqIn), abc, seqFmt);
+	while(seqI.hasNext()) {
+		PrimarySeq seq = seqI.nextSeq();
+		if(!msaNames.insert(seq.getId()).second) {
+			cerr << "Sequence '" << seq.getId() << "' is found already in the database or duplicated in '" << seqFn << "'" << endl;
+			return EXIT_FAILURE;
+		}
+		/* remove any gaps of aligned seqs */
+		string str;
+		for(string::const_iterator c = seq.getSeq().begin(); c != seq.getSeq().end(); ++c)
+			if(!abc->isGap(*c))
+				str.push_back(*c);
+		seqs.push_back(PrimarySeq(abc, seq.getId(), str));
+	}
+	infoLog << "Read in " << seqs.size() << " new reference sequences" << endl;
+
+	/* configure HMM mode for full-length references */
+	hmm.setSequenceMode(BandedHMMP7::GLOBAL);
+	hmm.wingRetract();
+
+	/* seed index built on the current tree */
+	SeedIndex sidx;
+	sidx.build(ptu);
+
+	/* align and place each new seq on the current tree */
+	const size_t N = seqs.size();
+	vector<BandedHMMP7::HmmAlignment> alns(N);
+	vector<PTUnrooted::PTPlacement> bestPlaces(N);
+	vector<double> branchLens(N);
+#pragma omp parallel
+	{
+#pragma omp single
+		{
+			for(size_t i = 0; i < N; ++i) {
+#pragma omp task
+				{
+					BandedHMMP7::HmmAlignment& aln = alns[i];
+					aln = alignSeq(hmm, csfm, seqs[i], DEFAULT_SEED_LEN, DEFAULT_SEED_REGION, BandedHMMP7::GLOBAL, DEFAULT_SEED_MISMATCH);
+					if(aln.isValid()) {
+						DigitalSeq seq(abc, seqs[i].getId(), aln.align);
+						vector<PTUnrooted::PTLoc> seeds = getSeed(ptu, sidx, seq, aln.csStart - 1, aln.csEnd - 1, inf, DEFAULT_MAX_NSEED);
+						vector<PTUnrooted::PTPlacement> places = estimateSeq(ptu, seq, seeds, DEFAULT_BRANCH_EST_METHOD);
+						filterPlacements(places, DEFAULT_MAX_PLACE_ERROR);
+						placeSeq(ptu, seq, places);
+						std::sort(places.rbegin(), places.rend(), compareByLoglik); /* sort places decently by real loglik */
+						bestPlaces[i] = places[0];
+						branchLens[i] = ptu.getBranchLength(places[0].cNode, places[0].pNode);
+					}
+				} /* end task */
+			}
+		} /* end single */
+#pragma omp taskwait
+	} /* end parallel */
+
+	/* graft the new seqs onto the tree at their best placements */
+	const string& rootName = ptu.getRoot()->getAnno();
+	vector<PrimarySeq> alignedSeqs;
+	vector<PTUnrooted::PTUNodePtr> leaves;
+	for(size_t i = 0; i < N; ++i) {
+		const string& id = seqs[i].getId();
+		if(!alns[i].isValid()) {
+			warningLog << "Unable to align new sequence '" << id << "' to the database, ignored" << endl;
+			continue;
+		}
+		const PTUnrooted::PTPlacement& place = bestPlaces[i];
+		/* the original branch might have been split by earlier grafts, locate the piece of this placement */
+		PTUnrooted::PTUNodePtr u = place.cNode;
+		double d = place.ratio * branchLens[i]; /* distance to the original child node */
+		while(u->getParent() != place.pNode && d > ptu.getBranchLength(u, u->getParent())) {
+			d -= ptu.getBranchLength(u, u->getParent());
+			u = u->getParent();
+		}
+		const PTUnrooted::PTUNodePtr v = u->getParent();
+		double w = ptu.getBranchLength(u, v);
+		double ratio = w > 0 ? std::min(d / w, 1.0) : 0;
+
+		boost::unordered_map<string, string>::const_iterator result = id2anno.find(id);
+		const string& name = result != id2anno.end() ? PTUnrooted::formatTaxonName(result->second) : "";
+		DigitalSeq seq(abc, name, alns[i].align);
+		PTUnrooted::PTUNodePtr leaf = ptu.graftSeq(seq, msa.getNumSeq() + alignedSeqs.size(), u, v, ratio, place.wnr);
+		ptu.annotate(leaf, rootName);
+		ptu.annotate(leaf->getParent(), rootName);
+		leaves.push_back(leaf);
+		alignedSeqs.push_back(PrimarySeq(abc, id, alns[i].align));
+		debugLog << "New sequence '" << id << "' placed at branch " << place.getId() << " with ratio " << place.ratio
+				<< " and annotated as " << leaf->getAnno() << endl;
+	}
+	if(leaves.empty()) {
+		cerr << "No new sequence can be placed onto the database" << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << leaves.size() << " new reference sequences placed onto the Phylogenetic tree" << endl;
+
+	/* re-evaluate the affected branches only */
+	long nBranch = ptu.evaluateGrafted(leaves);
+	infoLog << "Phylogenetic tree updated with " << nBranch << " of " << ptu.numEdges() << " branches re-evaluated, "
+			<< ptu.numAlignSites() << " aligned sites compressed into " << ptu.numSitePatterns() << " site patterns" << endl;
+	infoLog << "Final Tree log-liklihood: " << ptu.treeLoglik() << endl;
+
+	/* update the MSA and rebuild the indices */
+	msa.append(alignedSeqs);
+	msa.setName(outName);
+	infoLog << "MSA updated with " << msa.getNumSeq() << " X " << msa.getCSLen() << " aligned sequences" << endl;
+
+	csfm.build(msa, saRate, saIdx == "rg" ? CSFMIndex::RG : CSFMIndex::RRR);
+	if(csfm.isInitiated())
+		infoLog << "CSFM index rebuilt" << (csfm.is64() ? " with 64-bit suffix-array" : "") << endl;
+	else {
+		cerr << "Unable to build CSFM index" << endl;
+		return EXIT_FAILURE;
+	}
+
+	sidx.build(ptu);
+	infoLog << "Seed index rebuilt with " << sidx.numKeys() << " " << sidx.getKmerSize() << "-mer keys and "
+			<< sidx.numEntries() << " entries" << endl;
+
+	/* open output files after all inputs are consumed, so the database can be updated in place */
+	msaIn.close();
+	csfmIn.close();
+	hmmIn.close();
+	ptuIn.close();
+
+	string msaOutFn = outName + MSA_FILE_SUFFIX;
+	string csfmOutFn = outName + CSFM_FILE_SUFFIX;
+	string hmmOutFn = outName + HMM_FILE_SUFFIX;
+	string ptuOutFn = outName + PHYLOTREE_FILE_SUFFIX;
+	string sidxOutFn = outName + SEED_INDEX_FILE_SUFFIX;
+
+	msaOut.open(msaOutFn.c_str(), ios_base::out | ios_base::binary);
+	if(!msaOut.is_open()) {
+		cerr << "Unable to write to '" << msaOutFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	csfmOut.open(csfmOutFn.c_str(), ios_base::out | ios_base::binary);
+	if(!csfmOut.is_open()) {
+		cerr << "Unable to write to '" << csfmOutFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	ptuOut.open(ptuOutFn.c_str(), ios_base::out | ios_base::binary);
+	if(!ptuOut.is_open()) {
+		cerr << "Unable to write to '" << ptuOutFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	sidxOut.open(sidxOutFn.c_str(), ios_base::out | ios_base::binary);
+	if(!sidxOut.is_open()) {
+		cerr << "Unable to write to '" << sidxOutFn << "': " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+
+	infoLog << "Saving database files ..." << endl;
+	/* write database files, all with prepend program info */
+	saveProgInfo(msaOut);
+	msa.save(msaOut);
+	if(msaOut.bad()) {
+		cerr << "Unable to save MSA: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "MSA saved" << endl;
+
+	saveProgInfo(csfmOut);
+	csfm.save(csfmOut);
+	if(csfmOut.bad()) {
+		cerr << "Unable to save CSFM index: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "CSFM saved" << endl;
+
+	/* the HMM profile is unchanged, as the CS is kept */
+	if(outName != dbName) {
+		hmmIn.open(hmmFn.c_str());
+		hmmOut.open(hmmOutFn.c_str());
+		if(!hmmOut.is_open()) {
+			cerr << "Unable to write to '" << hmmOutFn << "': " << ::strerror(errno) << endl;
+			return EXIT_FAILURE;
+		}
+		hmmOut << hmmIn.rdbuf();
+		if(hmmOut.bad()) {
+			cerr << "Unable to save HMM profile: " << ::strerror(errno) << endl;
+			return EXIT_FAILURE;
+		}
+		infoLog << "Banded HMM profile saved" << endl;
+	}
+
+	saveProgInfo(ptuOut);
+	ptu.save(ptuOut);
+	if(ptuOut.bad()) {
+		cerr << "Unable to save Phylogenetic Tree index: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "Phylogenetic Tree index saved" << endl;
+
+	saveProgInfo(sidxOut);
+	sidx.save(sidxOut);
+	if(sidxOut.bad()) {
+		cerr << "Unable to save Seed index: " << ::strerror(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	infoLog << "Seed index saved" << endl;
+}
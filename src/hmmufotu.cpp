@@ -35,20 +35,52 @@ using namespace Eigen;
 /* default values */
 static const double DEFAULT_MAX_DIFF = inf;
 static const size_t DEFAULT_MAX_NSEED = 50;
+static const string DEFAULT_SEED_MODE = "index";
 static const int DEFAULT_SEED_LEN = 20;
 static const int MAX_SEED_LEN = 25;
 static const int MIN_SEED_LEN = 15;
 static const int DEFAULT_SEED_REGION = 50;
+static const int DEFAULT_SEED_MISMATCH = 1;
 static const double DEFAULT_MAX_PLACE_ERROR = 20;
 static const int DEFAULT_NUM_SEGMENT = 2;
 static const int MIN_NUM_SEGMENT = 2;
 static const int MAX_NUM_SEGMENT = 6;
 static const double DEFAULT_MIN_CHIMERA_LOD = 0;
 static const int DEFAULT_NUM_THREADS = 1;
+static const int DEFAULT_DEREP_BATCH = 0;
 static const string ALIGN_OUT_FMT = "fasta";
 static const string DEFAULT_BRANCH_EST_METHOD = "unweighted";
 static const string CHIMERA_TSV_HEADER = "seg5_taxon_id\tseg3_taxon_id\tseg5_taxon_anno\tseg3_taxon_anno\tchimera_lod";
 
+/**
+ * A group of reads (or read pairs) with identical sequences, which are aligned and placed only once
+ */
+struct ReadGroup {
+	/** construct an empty ReadGroup */
+	ReadGroup() { }
+
+	/** construct a ReadGroup with a representative read (pair) as its first member */
+	ReadGroup(const PrimarySeq& fwdRead, const PrimarySeq& revRead) : fwdRead(fwdRead), revRead(revRead) {
+		addMember(fwdRead);
+	}
+
+	/** get number of member reads */
+	size_t size() const {
+		return ids.size();
+	}
+
+	/** add a member read */
+	void addMember(const PrimarySeq& read) {
+		ids.push_back(read.getId());
+		descs.push_back(read.getDesc());
+	}
+
+	PrimarySeq fwdRead; /* representative forward read */
+	PrimarySeq revRead; /* representative reverse read, empty if not paired-end */
+	vector<string> ids; /* ids of all member reads */
+	vector<string> descs; /* descriptions of all member reads */
+};
+
 /**
  * Print introduction of this program
  */
@@ -75,9 +107,11 @@ void printUsage(const string& progName) {
 		 << "            --fmt  STR           : read file format (applied to all read files), supported format: 'fasta', 'fastq'" << endl
 		 << "            -L|--seed-len  INT   : seed length used for banded-Hmm search [" << DEFAULT_SEED_LEN << "]" << endl
 		 << "            -R  INT              : size of 5'/3' seed region for finding seed matches for CSFM-index [" << DEFAULT_SEED_REGION << "]" << endl
+		 << "            --seed-mm  INT       : max # of mismatches allowed for CSFM-index seed searches if no exact seed found, 0 to disable [" << DEFAULT_SEED_MISMATCH << "]" << endl
 		 << "            -s  FLAG             : assume READ-FILE1 is single-end read instead of assembled read, if no READ-FILE2 provided" << endl
 		 << "            -i|--ignore  FLAG    : ignore forward/reverse orientation check, only recommended when your read size is larger than the expected amplicon size" << endl
 		 << "            -N  INT              : max # of seed nodes used in the 'Seed' stage of SEP algorithm [" << DEFAULT_MAX_NSEED << "]" << endl
+		 << "            --seed-mode  STR     : node search mode used in the 'Seed' stage of SEP algorithm, must be one of 'index' (use the seed index if available), 'full' (check all nodes) or 'descent' (descend the tree from the root) [" << DEFAULT_SEED_MODE << "]" << endl
 		 << "            -d  DBL              : max p-dist difference allowed for sub-optimal seeds used in the 'Estimate' stage of SEP algorithm [" << DEFAULT_MAX_DIFF << "]" << endl
 		 << "            -e|--err  DBL        : max placement error used in the 'Estimate' stage of SEP algorithm [" << DEFAULT_MAX_PLACE_ERROR << "]" << endl
 		 << "            -m|--method  STR     : branch length estimating method during the estimated-placement stage, must be one of 'unweighted' or 'weighted' [" << DEFAULT_BRANCH_EST_METHOD << "]" << endl
@@ -89,6 +123,8 @@ void printUsage(const string& progName) {
 		 << "            --chimera-lod  DBL   : min log-odd required for defining a chimera read between best- and alt- segment alignments [" << DEFAULT_MIN_CHIMERA_LOD << "]" << endl
 		 << "            --chimera-out  FILE  : keep assignment output of chimera reads in FILE" << ZLIB_SUPPORT << endl
 		 << "            --chimera-info  FLAG : report detailed chimera information in assignment outputs" << endl
+		 << "            --derep  FLAG        : dereplicate identical reads (pairs), and only align and place each unique sequence once" << endl
+		 << "            --derep-batch  INT   : max # of reads dereplicated together to bound the memory usage, 0 for all reads [" << DEFAULT_DEREP_BATCH << "]" << endl
 		 << "            -S|--seed  INT       : random seed used for CSFM-index seed searches, for debug only" << endl
 #ifdef _OPENMP
 		 << "            -p|--process INT     : number of threads/cpus used for parallel processing" << endl
@@ -102,11 +138,11 @@ void printUsage(const string& progName) {
 int main(int argc, char* argv[]) {
 	/* variable declarations */
 	/* filenames */
-	string dbName, fwdFn, revFn, msaFn, csfmFn, hmmFn, ptuFn;
+	string dbName, fwdFn, revFn, msaFn, csfmFn, hmmFn, ptuFn, sidxFn;
 	string outFn, alnFn;
 	string chiOutFn;
 	/* input */
-	ifstream msaIn, csfmIn, hmmIn, ptuIn;
+	ifstream msaIn, csfmIn, hmmIn, ptuIn, sidxIn;
 	boost::iostreams::filtering_istream fwdIn, revIn;
 	/* output */
 	boost::iostreams::filtering_ostream out, alnOut;
@@ -123,8 +159,10 @@ int main(int argc, char* argv[]) {
 
 	int seedLen = DEFAULT_SEED_LEN;
 	int seedRegion = DEFAULT_SEED_REGION;
+	int seedMaxMismatch = DEFAULT_SEED_MISMATCH;
 	double maxDiff = DEFAULT_MAX_DIFF;
 	int maxNSeed = DEFAULT_MAX_NSEED;
+	string seedMode = DEFAULT_SEED_MODE;
 	double maxError = DEFAULT_MAX_PLACE_ERROR;
 	bool onlyML = false;
 	PTUnrooted::PRIOR_TYPE myPrior = PTUnrooted::UNIFORM;
@@ -133,6 +171,8 @@ int main(int argc, char* argv[]) {
 	double maxChimeraError = maxError / numSeg;
 	double minChimeraLod = DEFAULT_MIN_CHIMERA_LOD;
 	bool chimeraInfo = false;
+	bool derep = false;
+	int derepBatch = DEFAULT_DEREP_BATCH;
 
 	int nThreads = DEFAULT_NUM_THREADS;
 
@@ -178,6 +218,9 @@ int main(int argc, char* argv[]) {
 	if(cmdOpts.hasOpt("-R"))
 		seedRegion = ::atoi(cmdOpts.getOptStr("-R"));
 
+	if(cmdOpts.hasOpt("--seed-mm"))
+		seedMaxMismatch = ::atoi(cmdOpts.getOptStr("--seed-mm"));
+
 	if(cmdOpts.hasOpt("-i") || cmdOpts.hasOpt("--ignore"))
 		ignoreOrient = true;
 
@@ -190,6 +233,9 @@ int main(int argc, char* argv[]) {
 	if(cmdOpts.hasOpt("-N"))
 		maxNSeed = ::atoi(cmdOpts.getOptStr("-N"));
 
+	if(cmdOpts.hasOpt("--seed-mode"))
+		seedMode = cmdOpts.getOpt("--seed-mode");
+
 	if(cmdOpts.hasOpt("-e"))
 		maxError = ::atof(cmdOpts.getOptStr("-e"));
 	if(cmdOpts.hasOpt("--err"))
@@ -228,6 +274,11 @@ int main(int argc, char* argv[]) {
 			chimeraInfo = true;
 	}
 
+	if(cmdOpts.hasOpt("--derep"))
+		derep = true;
+	if(cmdOpts.hasOpt("--derep-batch"))
+		derepBatch = ::atoi(cmdOpts.getOptStr("--derep-batch"));
+
 	if(cmdOpts.hasOpt("-S"))
 		seed = ::atoi(cmdOpts.getOptStr("-S"));
 	if(cmdOpts.hasOpt("--seed"))
@@ -267,10 +318,24 @@ int main(int argc, char* argv[]) {
 		cerr << "-R cannot be smaller than -L" << endl;
 		return EXIT_FAILURE;
 	}
+	if(!(0 <= seedMaxMismatch && seedMaxMismatch <= CSFMIndex::MAX_MISMATCH)) {
+		cerr << "--seed-mm must be in range [0, " << CSFMIndex::MAX_MISMATCH << "]" << endl;
+		return EXIT_FAILURE;
+	}
 	if(!(maxDiff >= 0)) {
 		cerr << "-d must be non-negative" << endl;
 		return EXIT_FAILURE;
 	}
+	if(!(seedMode == "index" || seedMode == "full" || seedMode == "descent")) {
+		cerr << "--seed-mode must be one of 'index', 'full' or 'descent'" << endl;
+		return EXIT_FAILURE;
+	}
+
+	if(!(derepBatch >= 0)) {
+		cerr << "--derep-batch must be non-negative" << endl;
+		return EXIT_FAILURE;
+	}
+
 	if(!(maxNSeed > 0)) {
 		cerr << "-N must be positive" << endl;
 		return EXIT_FAILURE;
@@ -310,6 +375,7 @@ int main(int argc, char* argv[]) {
 	csfmFn = dbName + CSFM_FILE_SUFFIX;
 	hmmFn = dbName + HMM_FILE_SUFFIX;
 	ptuFn = dbName + PHYLOTREE_FILE_SUFFIX;
+	sidxFn = dbName + SEED_INDEX_FILE_SUFFIX;
 
 	/* set HMM align mode */
 	mode = !revFn.empty() /* paired-end */ || isAssembled ? BandedHMMP7::GLOBAL : BandedHMMP7::NGCL;
@@ -461,6 +527,8 @@ int main(int argc, char* argv[]) {
 		return EXIT_FAILURE;
 	}
 	infoLog << "CSFM-index loaded" << endl;
+	if(cmdOpts.hasOpt("-S") || cmdOpts.hasOpt("--seed"))
+		csfm.setRandomSeed(seed); /* otherwise use the default seed for reproducible results */
 	if(csfm.getCSLen() != csLen) {
 		cerr << "Error: Unmatched CS length between CSFM-index and MSA data" << endl;
 		return EXIT_FAILURE;
@@ -470,12 +538,48 @@ int main(int argc, char* argv[]) {
 		return EXIT_FAILURE;
 	PTUnrooted ptu;
 	if(!alignOnly) {
-		ptu.load(ptuIn);
+		ptu.load(ptuIn, ptuFn);
 		if(ptuIn.bad()) {
 			cerr << "Unable to load Phylogenetic tree data '" << ptuFn << "': " << ::strerror(errno) << endl;
 			return EXIT_FAILURE;
 		}
 		infoLog << "Phylogenetic tree loaded" << endl;
+		debugLog << "Using " << LikKernel::simdName() << " likelihood kernels" << endl;
+		debugLog << "Using " << PackedSeq::popcountName() << " popcount for seed p-dist" << endl;
+		if(ptu.isSinglePrec())
+			debugLog << "Tree likelihoods are stored in single precision" << endl;
+		if(ptu.isQuantized())
+			debugLog << "Tree likelihoods are stored 16-bit log-quantized and decoded when loaded" << endl;
+		if(ptu.isMapped())
+			debugLog << "Tree likelihoods are memory-mapped from the database file" << endl;
+	}
+
+	/* seed index is optional for databases built by older versions */
+	SeedIndex sidx;
+	if(!alignOnly && seedMode == "index") {
+		sidxIn.open(sidxFn.c_str(), ios_base::in | ios_base::binary);
+		if(!sidxIn)
+			warningLog << "Seed index '" << sidxFn << "' not found, all tree nodes will be checked in the 'Seed' stage" << endl;
+		else {
+			if(loadProgInfo(sidxIn).bad())
+				return EXIT_FAILURE;
+			sidx.load(sidxIn);
+			if(sidxIn.bad()) {
+				cerr << "Unable to load Seed index '" << sidxFn << "': " << ::strerror(errno) << endl;
+				return EXIT_FAILURE;
+			}
+			if(!sidx.isCompatible(ptu)) {
+				warningLog << "Seed index '" << sidxFn << "' was built on a tree with " << sidx.numNodes() << " nodes and "
+						<< sidx.getCSLen() << " CS sites, not matching the loaded tree with " << ptu.numNodes() << " nodes and "
+						<< ptu.numAlignSites() << " CS sites, all tree nodes will be checked in the 'Seed' stage" << endl;
+				sidx = SeedIndex(); /* fall back to scanning all nodes */
+			}
+			else {
+				infoLog << "Seed index loaded" << endl;
+				debugLog << "Seed index has " << sidx.numKeys() << " " << sidx.getKmerSize() << "-mer keys and "
+						<< sidx.numEntries() << " entries" << endl;
+			}
+		}
 	}
 
 	/* configure HMM mode */
@@ -483,6 +587,8 @@ int main(int argc, char* argv[]) {
 	hmm.wingRetract();
 
 	infoLog << "Processing read ..." << endl;
+	long nRead = 0; /* total reads (pairs) processed */
+	long nUnique = 0; /* total unique reads (pairs) processed */
 	/* process reads and output */
 	writeProgInfo(out, string(" taxonomy assignment generated by ") + argv[0]);
 	out << "# command: "<< cmdOpts.getCmdStr() << endl;
@@ -502,154 +608,192 @@ int main(int argc, char* argv[]) {
 #pragma omp single
 		{
 			while(fwdSeqI.hasNext() && (revFn.empty() || revSeqI.hasNext())) {
-				string id;
-				string desc;
-				PrimarySeq fwdRead, revRead;
-				bool isPaired = true;
-				bool isChimera = false;
-
-				fwdRead = fwdSeqI.nextSeq();
-				id = fwdRead.getId();
-				desc = fwdRead.getDesc();
-				if(!revFn.empty()) { /* paired-ended */
-					revRead = revSeqI.nextSeq().revcom();
-					assert(fwdRead.getId() == revRead.getId());
-				}
+				/* read the next read (pair), or the next batch of reads grouped by identical sequences if dereplicating */
+				vector<ReadGroup> groups;
+				boost::unordered_map<string, size_t> seq2group;
+				long nBatch = 0;
+				do {
+					PrimarySeq fwdRead, revRead;
+					fwdRead = fwdSeqI.nextSeq();
+					if(!revFn.empty()) { /* paired-ended */
+						revRead = revSeqI.nextSeq().revcom();
+						assert(fwdRead.getId() == revRead.getId());
+					}
+					nBatch++;
+					if(!derep) {
+						groups.push_back(ReadGroup(fwdRead, revRead));
+						break;
+					}
+					const string& key = fwdRead.getSeq() + "\t" + revRead.getSeq();
+					boost::unordered_map<string, size_t>::const_iterator result = seq2group.find(key);
+					if(result == seq2group.end()) { /* a new unique read (pair) */
+						seq2group[key] = groups.size();
+						groups.push_back(ReadGroup(fwdRead, revRead));
+					}
+					else
+						groups[result->second].addMember(fwdRead);
+				} while((derepBatch == 0 || nBatch < derepBatch) && fwdSeqI.hasNext() && (revFn.empty() || revSeqI.hasNext()));
+				nRead += nBatch;
+				nUnique += groups.size();
+
+				for(vector<ReadGroup>::const_iterator group = groups.begin(); group != groups.end(); ++group) {
+					ReadGroup readGroup = *group; /* copied into each task */
 #pragma omp task
-				{
-					BandedHMMP7::HmmAlignment aln;
-					/* align fwdRead */
-					aln = alignSeq(hmm, csfm, fwdRead, seedLen, seedRegion, mode);
-					assert(aln.isValid());
-					//						infoLog << "fwd seq aligned: csStart: " << csStart << " csEnd: " << csEnd << " aln: " << aln << endl;
-					if(!revFn.empty()) { /* align revRead */
-						//							cerr << "Aligning mate: " << revRead.getId() << endl;
-						BandedHMMP7::HmmAlignment revAln = alignSeq(hmm, csfm, revRead, seedLen, seedRegion, mode);
-						assert(revAln.isValid());
-						//							infoLog << "rev seq aligned: revStart: " << revStart << " revEnd: " << revEnd << " aln: " << revAln << endl;
-						if(!ignoreOrient && !(aln.csStart <= revAln.csStart && aln.csEnd <= revAln.csEnd)) {
+					{
+						const PrimarySeq& fwdRead = readGroup.fwdRead;
+						const PrimarySeq& revRead = readGroup.revRead;
+						const string& id = fwdRead.getId();
+						bool isChimera = false;
+						BandedHMMP7::HmmAlignment aln;
+						/* align fwdRead */
+						aln = alignSeq(hmm, csfm, fwdRead, seedLen, seedRegion, mode, seedMaxMismatch);
+						assert(aln.isValid());
+						//						infoLog << "fwd seq aligned: csStart: " << csStart << " csEnd: " << csEnd << " aln: " << aln << endl;
+						if(!revFn.empty()) { /* align revRead */
+							//							cerr << "Aligning mate: " << revRead.getId() << endl;
+							BandedHMMP7::HmmAlignment revAln = alignSeq(hmm, csfm, revRead, seedLen, seedRegion, mode, seedMaxMismatch);
+							assert(revAln.isValid());
+							//							infoLog << "rev seq aligned: revStart: " << revStart << " revEnd: " << revEnd << " aln: " << revAln << endl;
+							if(!ignoreOrient && !(aln.csStart <= revAln.csStart && aln.csEnd <= revAln.csEnd)) {
 #pragma omp critical(writeLog)
-						{
-							warningLog << "Bad orientation of forward/reverse read detected, treating as chimera" << endl;
-							infoLog << "fwd.csStart: " << aln.csStart << " fwd.csEnd: " << aln.csEnd
-									<< " rev.csStart: " << revAln.csStart << " rev.csEnd" << revAln.csEnd << endl;
-						}
-							isChimera = true; /* bad orientation indicates a chimera seq */
+							{
+								warningLog << "Bad orientation of forward/reverse read detected, treating as chimera" << endl;
+								infoLog << "fwd.csStart: " << aln.csStart << " fwd.csEnd: " << aln.csEnd
+										<< " rev.csStart: " << revAln.csStart << " rev.csEnd" << revAln.csEnd << endl;
+							}
+								isChimera = true; /* bad orientation indicates a chimera seq */
+							}
+							else
+								aln.merge(revAln); /* merge alignment */
 						}
-						else
-							aln.merge(revAln); /* merge alignment */
-					}
-					DigitalSeq seq(abc, id, aln.align);
-					/* common seeds used for both segments and whole seq */
-					vector<PTUnrooted::PTLoc> seeds;
-					if(checkChimera && !isChimera || !alignOnly) {
-						seeds = getSeed(ptu, seq, aln.csStart - 1, aln.csEnd - 1);
-						if(seeds.size() > maxNSeed)
-							seeds.erase(seeds.end() - (seeds.size() - maxNSeed), seeds.end()); /* remove bad seeds */
-					}
-					PTUnrooted::PTPlacement bestPlace;
-					double chimeraLod = EGriceLab::HmmUFOtu::nan;
-					PTUnrooted::PTPlacement bestSeg5Place;
-					PTUnrooted::PTPlacement bestSeg3Place;
-					if(checkChimera && !isChimera) { /* need further chimera checking */
-						/* get segment seeds */
-						vector<PTUnrooted::PTPlacement> seg5Places; /* placements of 5' segments */
-						vector<PTUnrooted::PTPlacement> seg3Places; /* placements of 3' segments */
-						const int segLen = (aln.csEnd - aln.csStart + 1) / numSeg;
-						for(int n = 0; n < numSeg; ++n) {
-							int segStart = aln.csStart + n * segLen; /* 1-based */
-							int segEnd = segStart + segLen - 1;      /* 1-based */
-							/* get segment seeds using common seeds */
-							vector<PTUnrooted::PTLoc> segSeeds;
-							segSeeds.reserve(seeds.size());
-							for(vector<PTUnrooted::PTLoc>::const_iterator s = seeds.begin(); s != seeds.end(); ++s)
-								segSeeds.push_back(PTUnrooted::PTLoc(segStart - 1, segEnd - 1, s->id, SeqUtils::pDist(seq, ptu.getNode(s->id)->getSeq(), segStart - 1, segEnd - 1)));
-							/* estimate segment placements */
-							vector<PTUnrooted::PTPlacement> segPlaces = estimateSeq(ptu, seq, segSeeds, estMethod);
-							/* filter placesments for this segment */
-							filterPlacements(segPlaces, maxChimeraError);
-							placeSeq(ptu, seq, segPlaces);
-							/* add placements of this segment to the larget lists */
-							if(n < numSeg / 2)
-								seg5Places.insert(seg5Places.end(), segPlaces.begin(), segPlaces.end());
+						DigitalSeq seq(abc, id, aln.align);
+						/* common seeds used for both segments and whole seq */
+						vector<PTUnrooted::PTLoc> seeds;
+						if(checkChimera && !isChimera || !alignOnly) {
+							if(seedMode == "descent")
+								seeds = getSeedDescent(ptu, seq, aln.csStart - 1, aln.csEnd - 1, maxDiff, maxNSeed);
+							else if(!sidx.empty())
+								seeds = getSeed(ptu, sidx, seq, aln.csStart - 1, aln.csEnd - 1, maxDiff, maxNSeed);
 							else
-								seg3Places.insert(seg3Places.end(), segPlaces.begin(), segPlaces.end());
+								seeds = getSeed(ptu, seq, aln.csStart - 1, aln.csEnd - 1, maxDiff, maxNSeed);
 						}
-						std::sort(seg5Places.rbegin(), seg5Places.rend(), compareByLoglik);
-						std::sort(seg3Places.rbegin(), seg3Places.rend(), compareByLoglik);
-						bestSeg5Place = seg5Places[0];
-						bestSeg3Place = seg3Places[0];
-						/* get alt-seg5-place */
-						PTUnrooted::PTLoc alt5Loc(bestSeg5Place.start, bestSeg5Place.end, bestSeg3Place.cNode->getId() /* seg3 branch */, SeqUtils::pDist(seq, bestSeg5Place.cNode->getSeq(), bestSeg5Place.start, bestSeg5Place.end));
-						PTUnrooted::PTPlacement altSeg5Place = ptu.estimateSeq(seq, alt5Loc);
-						ptu.placeSeq(seq, altSeg5Place);
-						/* get alt-seg3-place */
-						PTUnrooted::PTLoc alt3Loc(bestSeg3Place.start, bestSeg3Place.end, bestSeg5Place.cNode->getId() /* seg5 branch */, SeqUtils::pDist(seq, bestSeg3Place.cNode->getSeq(), bestSeg3Place.start, bestSeg3Place.end));
-						PTUnrooted::PTPlacement altSeg3Place = ptu.estimateSeq(seq, alt3Loc);
-						ptu.placeSeq(seq, altSeg3Place);
-						chimeraLod = bestSeg5Place.loglik - altSeg5Place.loglik + bestSeg3Place.loglik - altSeg3Place.loglik;
-						isChimera = bestSeg5Place.getTaxonId() != bestSeg3Place.getTaxonId() && chimeraLod > minChimeraLod;
-					} /* end check chimera */
-
-					if(isChimera) { /* a potential chimera sequence */
-						if(chiOut.is_complete())
-							if(!chimeraInfo)
+						PTUnrooted::PTPlacement bestPlace;
+						double chimeraLod = EGriceLab::HmmUFOtu::nan;
+						PTUnrooted::PTPlacement bestSeg5Place;
+						PTUnrooted::PTPlacement bestSeg3Place;
+						if(checkChimera && !isChimera) { /* need further chimera checking */
+							/* get segment seeds */
+							vector<PTUnrooted::PTPlacement> seg5Places; /* placements of 5' segments */
+							vector<PTUnrooted::PTPlacement> seg3Places; /* placements of 3' segments */
+							vector<vector<PTUnrooted::PTPlacement> > segPlaces(numSeg); /* placements of each segment */
+							const int segLen = (aln.csEnd - aln.csStart + 1) / numSeg;
+							for(int n = 0; n < numSeg; ++n) {
+#pragma omp task shared(aln, seeds, seq, segPlaces)
+								{
+									int segStart = aln.csStart + n * segLen; /* 1-based */
+									int segEnd = segStart + segLen - 1;      /* 1-based */
+									/* get segment seeds using common seeds */
+									vector<PTUnrooted::PTLoc> segSeeds;
+									segSeeds.reserve(seeds.size());
+									for(vector<PTUnrooted::PTLoc>::const_iterator s = seeds.begin(); s != seeds.end(); ++s)
+										segSeeds.push_back(PTUnrooted::PTLoc(segStart - 1, segEnd - 1, s->id, SeqUtils::pDist(seq, ptu.getNode(s->id)->getSeq(), segStart - 1, segEnd - 1)));
+									/* estimate segment placements */
+									segPlaces[n] = estimateSeq(ptu, seq, segSeeds, estMethod);
+									/* filter placesments for this segment */
+									filterPlacements(segPlaces[n], maxChimeraError);
+									placeSeq(ptu, seq, segPlaces[n]);
+								}
+							}
+#pragma omp taskwait
+							/* add placements of all segments to the larget lists */
+							for(int n = 0; n < numSeg; ++n) {
+								if(n < numSeg / 2)
+									seg5Places.insert(seg5Places.end(), segPlaces[n].begin(), segPlaces[n].end());
+								else
+									seg3Places.insert(seg3Places.end(), segPlaces[n].begin(), segPlaces[n].end());
+							}
+							std::sort(seg5Places.rbegin(), seg5Places.rend(), compareByLoglik);
+							std::sort(seg3Places.rbegin(), seg3Places.rend(), compareByLoglik);
+							bestSeg5Place = seg5Places[0];
+							bestSeg3Place = seg3Places[0];
+							/* get alt-seg5-place */
+							PTUnrooted::PTLoc alt5Loc(bestSeg5Place.start, bestSeg5Place.end, bestSeg3Place.cNode->getId() /* seg3 branch */, SeqUtils::pDist(seq, bestSeg5Place.cNode->getSeq(), bestSeg5Place.start, bestSeg5Place.end));
+							PTUnrooted::PTPlacement altSeg5Place = ptu.estimateSeq(seq, alt5Loc);
+							ptu.placeSeq(seq, altSeg5Place);
+							/* get alt-seg3-place */
+							PTUnrooted::PTLoc alt3Loc(bestSeg3Place.start, bestSeg3Place.end, bestSeg5Place.cNode->getId() /* seg5 branch */, SeqUtils::pDist(seq, bestSeg3Place.cNode->getSeq(), bestSeg3Place.start, bestSeg3Place.end));
+							PTUnrooted::PTPlacement altSeg3Place = ptu.estimateSeq(seq, alt3Loc);
+							ptu.placeSeq(seq, altSeg3Place);
+							chimeraLod = bestSeg5Place.loglik - altSeg5Place.loglik + bestSeg3Place.loglik - altSeg3Place.loglik;
+							isChimera = bestSeg5Place.getTaxonId() != bestSeg3Place.getTaxonId() && chimeraLod > minChimeraLod;
+						} /* end check chimera */
+
+						if(isChimera) { /* a potential chimera sequence */
+							if(chiOut.is_complete())
+								if(!chimeraInfo)
 #pragma omp critical(writeChiAssign)
-								chiOut << id << "\t" << desc << "\t" << aln
-								<< "\t" << bestPlace << endl;
-							else
+									for(size_t i = 0; i < readGroup.size(); ++i)
+										chiOut << readGroup.ids[i] << "\t" << readGroup.descs[i] << "\t" << aln
+										<< "\t" << bestPlace << endl;
+								else
 #pragma omp critical(writeChiAssign)
-								chiOut << id << "\t" << desc << "\t" << aln
-								<< "\t" << bestSeg5Place.getTaxonId() << "\t" << bestSeg3Place.getTaxonId()
-								<< "\t" << bestSeg5Place.getTaxonName() << "\t" << bestSeg3Place.getTaxonName()
-								<< "\t" << chimeraLod
-								<< "\t" << bestPlace << endl;
-					}
-					else { /* not a chimera sequence */
-						/* write the alignment seq to output */
-						if(!alnFn.empty()) {
-							string desc = fwdRead.getDesc();
-							desc += ";csStart=" + boost::lexical_cast<string>(aln.csStart) +
-									";csEnd=" + boost::lexical_cast<string>(aln.csEnd) + ";";
-#pragma omp critical(writeAln)
-							alnSeqO.writeSeq(PrimarySeq(abc, id, aln.align, desc));
+									for(size_t i = 0; i < readGroup.size(); ++i)
+										chiOut << readGroup.ids[i] << "\t" << readGroup.descs[i] << "\t" << aln
+										<< "\t" << bestSeg5Place.getTaxonId() << "\t" << bestSeg3Place.getTaxonId()
+										<< "\t" << bestSeg5Place.getTaxonName() << "\t" << bestSeg3Place.getTaxonName()
+										<< "\t" << chimeraLod
+										<< "\t" << bestPlace << endl;
 						}
-
-						if(!alignOnly) {
-							/* place seq with seed-estimate-place (SEP) algorithm */
-							/* estimate placements using the common seeds */
-							vector<PTUnrooted::PTPlacement> places = estimateSeq(ptu, seq, seeds, estMethod);
-							/* filter placements */
-							filterPlacements(places, maxError);
-							/* accurate placements */
-							placeSeq(ptu, seq, places);
-							if(onlyML) { /* don't calculate q-values */
-								std::sort(places.rbegin(), places.rend(), compareByLoglik); /* sort places decently by real loglik */
-							}
-							else { /* calculate q-values */
-								calcQValues(places, myPrior);
-								std::sort(places.rbegin(), places.rend(), compareByQPlace); /* sort places decently by posterior placement probability */
+						else { /* not a chimera sequence */
+							/* write the alignment seq to output */
+							if(!alnFn.empty()) {
+								const string& csLoc = ";csStart=" + boost::lexical_cast<string>(aln.csStart) +
+										";csEnd=" + boost::lexical_cast<string>(aln.csEnd) + ";";
+#pragma omp critical(writeAln)
+								for(size_t i = 0; i < readGroup.size(); ++i)
+									alnSeqO.writeSeq(PrimarySeq(abc, readGroup.ids[i], aln.align, readGroup.descs[i] + csLoc));
 							}
 
-							bestPlace = places[0];
-						} /* end if alignOnly */
-						/* write main output */
-						if(!chimeraInfo)
+							if(!alignOnly) {
+								/* place seq with seed-estimate-place (SEP) algorithm */
+								/* estimate placements using the common seeds */
+								vector<PTUnrooted::PTPlacement> places = estimateSeq(ptu, seq, seeds, estMethod);
+								/* filter placements */
+								filterPlacements(places, maxError);
+								/* accurate placements */
+								placeSeq(ptu, seq, places);
+								if(onlyML) { /* don't calculate q-values */
+									std::sort(places.rbegin(), places.rend(), compareByLoglik); /* sort places decently by real loglik */
+								}
+								else { /* calculate q-values */
+									calcQValues(places, myPrior);
+									std::sort(places.rbegin(), places.rend(), compareByQPlace); /* sort places decently by posterior placement probability */
+								}
+
+								bestPlace = places[0];
+							} /* end if alignOnly */
+							/* write main output */
+							if(!chimeraInfo)
 #pragma omp critical(writeAssign)
-							out << id << "\t" << desc << "\t" << aln
-							<< "\t" << bestPlace << endl;
-						else
+								for(size_t i = 0; i < readGroup.size(); ++i)
+									out << readGroup.ids[i] << "\t" << readGroup.descs[i] << "\t" << aln
+									<< "\t" << bestPlace << endl;
+							else
 #pragma omp critical(writeAssign)
-							out << id << "\t" << desc << "\t" << aln
-							<< "\t" << bestSeg5Place.getTaxonId() << "\t" << bestSeg3Place.getTaxonId()
-							<< "\t" << bestSeg5Place.getTaxonName() << "\t" << bestSeg3Place.getTaxonName()
-							<< "\t" << chimeraLod
-							<< "\t" << bestPlace << endl;
-					} /* end not chimera alignment */
-				} /* end task */
-			} /* end each read/pair */
+								for(size_t i = 0; i < readGroup.size(); ++i)
+									out << readGroup.ids[i] << "\t" << readGroup.descs[i] << "\t" << aln
+									<< "\t" << bestSeg5Place.getTaxonId() << "\t" << bestSeg3Place.getTaxonId()
+									<< "\t" << bestSeg5Place.getTaxonName() << "\t" << bestSeg3Place.getTaxonName()
+									<< "\t" << chimeraLod
+									<< "\t" << bestPlace << endl;
+						} /* end not chimera alignment */
+					} /* end task */
+				} /* end each read group */
+			} /* end each read/pair or batch */
 		} /* end single */
 #pragma omp taskwait
 	} /* end parallel */
+	if(derep)
+		infoLog << "Total " << nRead << " reads dereplicated into " << nUnique << " unique sequences" << endl;
 	/* release resources */
 }
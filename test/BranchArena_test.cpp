@@ -0,0 +1,116 @@
+/*
+ * BranchArena_test.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "BranchArena.h"
+
+using namespace std;
+using namespace EGriceLab::HmmUFOtu;
+
+static const double MAX_QUANT_REL_ERR = 7e-4; /* the ~0.07% claimed by hmmufotu-build --quantize */
+static const char* TMP_FN = "BranchArena_test.tmp";
+
+/* random lik log-uniformly distributed in the quantized range [2^-QUANT_LOG2_RANGE, 1] */
+static double randLik() {
+	return ::pow(2.0, -BranchArena::QUANT_LOG2_RANGE * (::rand() / (RAND_MAX + 1.0)));
+}
+
+/* max relative error between two arenas in their own precisions */
+static double maxRelErr(const BranchArena& arena, const Matrix4Xd& lik) {
+	Matrix4Xd obs = arena.isSinglePrec() ? Matrix4Xd(arena.likF.cast<double>()) : Matrix4Xd(arena.lik);
+	double maxErr = 0;
+	for(long i = 0; i < lik.size(); ++i)
+		maxErr = std::max(maxErr, lik.data()[i] == obs.data()[i] ? 0 : ::fabs(obs.data()[i] - lik.data()[i]) / ::fabs(lik.data()[i]));
+	return maxErr;
+}
+
+int main() {
+	::srand(0);
+
+	/* quantization error */
+	double maxErr = 0;
+	for(int i = 0; i < 1000000; ++i) {
+		double x = randLik();
+		maxErr = std::max(maxErr, ::fabs(BranchArena::decodeLik(BranchArena::encodeLik(x)) - x) / x);
+	}
+	cout << "16-bit log-quantization max relative error: " << maxErr << endl;
+	if(!(maxErr <= MAX_QUANT_REL_ERR))
+		return EXIT_FAILURE;
+	if(!(BranchArena::decodeLik(BranchArena::encodeLik(0)) == 0 && BranchArena::decodeLik(BranchArena::encodeLik(-1)) == -1
+			&& BranchArena::decodeLik(BranchArena::encodeLik(2)) == 1))
+		return EXIT_FAILURE;
+	/* decoded values must be encoded back to the same codes, so quantized databases are saved losslessly */
+	for(int code = BranchArena::ZERO_CODE; code <= BranchArena::INVALID_CODE; ++code) {
+		if(BranchArena::encodeLik(BranchArena::decodeLik(code)) != code) {
+			cerr << "Quantization code " << code << " is not stable after decoding" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* save and load round trips */
+	const long nCol = 1001;
+	Matrix4Xd lik(4, nCol);
+	for(long i = 0; i < lik.size(); ++i)
+		lik.data()[i] = randLik();
+	lik(0, 0) = -1; /* invalid marker */
+	lik(1, 0) = 0;
+	BranchArena src;
+	src.grow(nCol, 0);
+	src.lik = lik;
+	for(long j = 0; j < nCol; ++j)
+		src.scale(j) = ::rand() % 100;
+
+	const BranchArena::LikEncoding encs[] = { BranchArena::DOUBLE_LIK, BranchArena::FLOAT_LIK, BranchArena::QUANT16_LIK };
+	const char* encNames[] = { "double", "float", "quant16" };
+	const double maxRelErrs[] = { 0, 1e-6, MAX_QUANT_REL_ERR }; /* float lik near 2^-128 are subnormal */
+	for(int e = 0; e < 3; ++e) {
+		ofstream out(TMP_FN, ios_base::out | ios_base::binary);
+		src.writeLik(out, 0, nCol, encs[e]);
+		out.write((const char*) src.scale.data(), sizeof(int) * nCol);
+		out.close();
+		if(out.bad())
+			return EXIT_FAILURE;
+
+		BranchArena dest;
+		ifstream in(TMP_FN, ios_base::in | ios_base::binary);
+		dest.read(in, nCol, encs[e]);
+		if(!in.good() || in.peek() != EOF) { /* must consume exactly the written bytes */
+			cerr << "Unable to read " << encNames[e] << " arena" << endl;
+			return EXIT_FAILURE;
+		}
+		double err = maxRelErr(dest, lik);
+		cout << "Read " << encNames[e] << " arena max relative error: " << err << endl;
+		if(!(dest.cols() == nCol && dest.isSinglePrec() == (encs[e] != BranchArena::DOUBLE_LIK) && !dest.isMapped()
+				&& err <= maxRelErrs[e] && dest.scale == src.scale))
+			return EXIT_FAILURE;
+
+		BranchArena mapped;
+		if(mapped.mapFile(TMP_FN, 0, nCol, encs[e])) {
+			err = maxRelErr(mapped, lik);
+			cout << "Mapped " << encNames[e] << " arena max relative error: " << err << endl;
+			if(!(mapped.cols() == nCol && mapped.isMapped() && err <= maxRelErrs[e] && mapped.scale == src.scale))
+				return EXIT_FAILURE;
+			/* writing a mapped arena must not change the file */
+			mapped.scale.setZero();
+			BranchArena reread;
+			ifstream in2(TMP_FN, ios_base::in | ios_base::binary);
+			reread.read(in2, nCol, encs[e]);
+			if(!(reread.scale == src.scale))
+				return EXIT_FAILURE;
+		}
+		else
+			cout << "Memory mapping not supported, skipping mapped " << encNames[e] << " arena" << endl;
+	}
+	::remove(TMP_FN);
+
+	return EXIT_SUCCESS;
+}
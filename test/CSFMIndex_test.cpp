@@ -60,4 +60,86 @@ int main() {
 	cout << "Found random matched CSLoc: " << loc.start << "-" << loc.end << endl;
 	if(!(loc.start == 1 && loc.end == 3))
 		return EXIT_FAILURE;
+
+	/* test locateBest */
+	double agreement = 0;
+	loc = csfm.locateBest(pat, agreement);
+	cout << "Found best matched CSLoc: " << loc.start << "-" << loc.end << " with agreement " << agreement << endl;
+	if(!(loc.start == 1 && loc.end == 3 && agreement == 1 && csfm.getCSIdentity(loc) == 1))
+		return EXIT_FAILURE;
+	loc = csfm.locateBest("TC", agreement);
+	cout << "Found best matched CSLoc of TC: " << loc.start << "-" << loc.end << " with agreement " << agreement << endl;
+	if(!(loc.start == 2 && loc.end == 3 && agreement == 0.8))
+		return EXIT_FAILURE;
+	/* test deterministic locateOne */
+	if(csfm.locateOne("CG").start != csfm.locateOne("CG").start)
+		return EXIT_FAILURE;
+
+	/* test gaps within located regions */
+	loc = csfm.locateFirst("GGT");
+	cout << "Found first matched CSLoc of GGT: " << loc.start << "-" << loc.end << " with " << loc.nGap << " gaps" << endl;
+	if(!(loc.start == 5 && loc.end == 8 && loc.nGap == 1 && loc.isValid(1, 3)))
+		return EXIT_FAILURE;
+
+	/* test locateOneApprox */
+	string pat3 = "ATCCGA";
+	if(csfm.locateOne(pat3).isValid() || csfm.locateOneApprox(pat3, 0).isValid())
+		return EXIT_FAILURE;
+	loc = csfm.locateOneApprox(pat3, 1);
+	cout << "Found 1-mismatch matched CSLoc of " << pat3 << ": " << loc.start << "-" << loc.end << endl;
+	if(!(loc.isValid() && loc.start == 1 && loc.end == 6))
+		return EXIT_FAILURE;
+	loc = csfm.locateOneApprox(pat, 2); /* exact matches found first */
+	if(!(loc.start == 1 && loc.end == 3))
+		return EXIT_FAILURE;
+
+	/* test other SA sample rates and index types */
+	string pat2 = "CGG";
+	for(uint32_t rate = 1; rate <= 8; rate *= 2) {
+		for(int type = CSFMIndex::RRR; type <= CSFMIndex::RG; ++type) {
+			CSFMIndex csfm2;
+			csfm2.build(msa, rate, static_cast<CSFMIndex::SA_IDX_TYPE> (type));
+			/* save and load back */
+			stringstream buf;
+			csfm2.save(buf);
+			CSFMIndex csfm3;
+			csfm3.load(buf);
+			set<unsigned> idx = csfm3.locateIndex(pat2);
+			cout << "Found " << idx.size() << " seqs with matches of " << pat2 << " with SA sample rate " << rate << " and index type " << type << endl;
+			if(!(csfm3.getSASampleRate() == rate && csfm3.getSAIdxType() == type
+					&& idx.size() == 2 && idx.count(1) == 1 && idx.count(3) == 1))
+				return EXIT_FAILURE;
+			vector<CSLoc> locs = csfm3.locate(pat2);
+			for(vector<CSLoc>::const_iterator loc = locs.begin(); loc != locs.end(); ++loc) {
+				if(!((loc->start == 4 && loc->end == 6) || (loc->start == 5 && loc->end == 7)))
+					return EXIT_FAILURE;
+			}
+		}
+	}
+
+	/* test MSA with wide consensus length */
+	const unsigned wideLen = UINT16_MAX + 100;
+	string wideSeq1(wideLen, '-');
+	string wideSeq2(wideLen, '-');
+	wideSeq1.replace(0, 4, "ACGT");
+	wideSeq1.replace(wideLen - 6, 6, "TTGCAA");
+	wideSeq2.replace(wideLen - 10, 10, "GGGTTGCAAC");
+	istringstream wideIn(">wide1\n" + wideSeq1 + "\n>wide2\n" + wideSeq2 + "\n");
+	MSA wideMsa;
+	wideMsa.loadMSA(wideIn, "fasta");
+	CSFMIndex wideCsfm;
+	wideCsfm.build(wideMsa);
+	stringstream wideBuf;
+	wideCsfm.save(wideBuf);
+	CSFMIndex wideCsfm2;
+	wideCsfm2.load(wideBuf);
+	locs = wideCsfm2.locate("TTGCAA");
+	cout << "Found " << locs.size() << " matches of TTGCAA in MSA with CS length " << wideCsfm2.getCSLen() << endl;
+	if(!(wideCsfm2.isWideCS() && !wideCsfm2.is64() && locs.size() == 2))
+		return EXIT_FAILURE;
+	for(vector<CSLoc>::const_iterator loc = locs.begin(); loc != locs.end(); ++loc) {
+		if(!(loc->start == wideLen - 5 && loc->end == wideLen && loc->nGap == 0
+				|| loc->start == wideLen - 6 && loc->end == wideLen - 1 && loc->nGap == 0))
+			return EXIT_FAILURE;
+	}
 }
@@ -0,0 +1,65 @@
+/*
+ * LikKernel_test.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include "LikKernel.h"
+
+using namespace std;
+using namespace EGriceLab::HmmUFOtu;
+
+static const double MAX_REL_ERR = 1e-14; /* FMA and reordered sums may differ from scalar by a few ulps */
+
+/* random positive value in (0, 1] spanning a few orders of magnitude, as cached partials do */
+static double randLik() {
+	return ::pow(10.0, -3.0 * ::rand() / RAND_MAX) * (::rand() + 1.0) / (RAND_MAX + 1.0);
+}
+
+int main() {
+	::srand(0);
+	const LikKernel::SIMD_TYPE types[] = { LikKernel::SSE2, LikKernel::AVX2 };
+	const long sizes[] = { 0, 1, 2, 3, 8, 31, 257 }; /* odd sizes exercise the AVX2 2-site tail */
+	const LikKernel::TransMultProdFunc scalar = LikKernel::getTransMultProd(LikKernel::SCALAR);
+
+	cout << "Using " << LikKernel::simdName() << " likelihood kernels by default" << endl;
+	for(size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+		if(!LikKernel::isSupported(types[t])) {
+			cout << "Skipping unsupported " << LikKernel::simdName(types[t]) << " kernel" << endl;
+			continue;
+		}
+		const LikKernel::TransMultProdFunc kernel = LikKernel::getTransMultProd(types[t]);
+		for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+			const long n = sizes[s];
+			double P[16];
+			for(int i = 0; i < 16; ++i)
+				P[i] = randLik();
+			vector<double> X(4 * n + 1), Y0(4 * n + 1);
+			for(long i = 0; i < 4 * n + 1; ++i) {
+				X[i] = randLik();
+				Y0[i] = randLik();
+			}
+			vector<double> expected(Y0), observed(Y0);
+			scalar(P, &X[0], &expected[0], n);
+			kernel(P, &X[0], &observed[0], n);
+
+			double maxErr = 0;
+			for(long i = 0; i < 4 * n; ++i)
+				maxErr = std::max(maxErr, ::fabs(observed[i] - expected[i]) / expected[i]);
+			cout << LikKernel::simdName(types[t]) << " kernel on " << n << " sites max relative error: " << maxErr << endl;
+			if(!(maxErr <= MAX_REL_ERR))
+				return EXIT_FAILURE;
+			if(observed[4 * n] != Y0[4 * n]) { /* must not write past the last site */
+				cerr << LikKernel::simdName(types[t]) << " kernel wrote past " << n << " sites" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+/*
+ * PackedSeq_test.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include "HmmUFOtu_common.h"
+
+using namespace std;
+using namespace EGriceLab::HmmUFOtu;
+
+/* bases, lower-case and ambiguous bases and gaps */
+static const string SYMBOLS = "ACGTACGTACGTNRYUacgt-._";
+
+static string randSeq(int len) {
+	string seq(len, '-');
+	for(int i = 0; i < len; ++i)
+		seq[i] = SYMBOLS[::rand() % SYMBOLS.length()];
+	return seq;
+}
+
+/* compare the packed p-dist to SeqUtils::pDist, both are NaN if no shared non-gap sites */
+static bool isSame(double packedDist, double dist) {
+	return packedDist == dist || (::isnan(packedDist) && ::isnan(dist));
+}
+
+int main() {
+	::srand(0);
+	const DegenAlphabet* abc = AlphabetFactory::getAlphabetByName("DNA");
+	const int lens[] = { 1, 63, 64, 65, 200 };
+	cout << "Using " << PackedSeq::popcountName() << " popcount" << endl;
+	for(size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); ++l) {
+		const int L = lens[l];
+		for(int n = 0; n < 20; ++n) {
+			DigitalSeq seq1(abc, "seq1", randSeq(L));
+			DigitalSeq seq2(abc, "seq2", randSeq(L));
+			const PackedSeq packed1(seq1);
+			const PackedSeq packed2(seq2);
+			if(!(packed1.length() == L && packed2.length() == L))
+				return EXIT_FAILURE;
+			/* whole seq */
+			if(!isSame(packed1.pDist(packed2), SeqUtils::pDist(seq1, seq2))) {
+				cerr << "Unmatched p-dist of length " << L << " seqs" << endl;
+				return EXIT_FAILURE;
+			}
+			/* random regions, mostly not on word boundaries */
+			for(int r = 0; r < 20; ++r) {
+				int start = ::rand() % L;
+				int end = start + ::rand() % (L - start);
+				double packedDist = packed1.pDist(packed2, start, end);
+				double dist = SeqUtils::pDist(seq1, seq2, start, end);
+				if(!isSame(packedDist, dist)) {
+					cerr << "Unmatched p-dist in region [" << start << ", " << end << "] of length " << L << " seqs: "
+							<< packedDist << " != " << dist << endl;
+					return EXIT_FAILURE;
+				}
+			}
+		}
+	}
+
+	/* fixed regions around the word boundaries */
+	DigitalSeq seq1(abc, "seq1", randSeq(200));
+	DigitalSeq seq2(abc, "seq2", randSeq(200));
+	const PackedSeq packed1(seq1);
+	const PackedSeq packed2(seq2);
+	const int bounds[][2] = { { 0, 63 }, { 0, 64 }, { 63, 64 }, { 63, 63 }, { 64, 127 }, { 1, 126 }, { 60, 140 }, { 128, 199 } };
+	for(size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); ++i) {
+		double packedDist = packed1.pDist(packed2, bounds[i][0], bounds[i][1]);
+		double dist = SeqUtils::pDist(seq1, seq2, bounds[i][0], bounds[i][1]);
+		cout << "p-dist in region [" << bounds[i][0] << ", " << bounds[i][1] << "]: " << packedDist << endl;
+		if(!isSame(packedDist, dist))
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+/*
+ * SeedSelect_test.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: zhengqi
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include "HmmUFOtu.h"
+#include "HmmUFOtu_main.h"
+
+using namespace std;
+using namespace EGriceLab::HmmUFOtu;
+
+/* build candidate seeds with the given p-dists, node ids following their input order */
+static vector<PTUnrooted::PTLoc> getLocs(const double* dists, size_t n) {
+	vector<PTUnrooted::PTLoc> locs;
+	for(size_t i = 0; i < n; ++i)
+		locs.push_back(PTUnrooted::PTLoc(0, 99, i, dists[i]));
+	return locs;
+}
+
+int main() {
+	const double dists[] = { 0.3, 0.1, 0.12, 0.1, 0.25, 0.1 };
+	const size_t n = sizeof(dists) / sizeof(dists[0]);
+
+	/* no filtering */
+	vector<PTUnrooted::PTLoc> locs = getLocs(dists, n);
+	selectSeed(locs, inf, n);
+	cout << "Selected " << locs.size() << " seeds with maxDiff inf" << endl;
+	if(locs.size() != n)
+		return EXIT_FAILURE;
+	for(size_t i = 1; i < locs.size(); ++i)
+		if(locs[i].dist < locs[i - 1].dist) /* must be sorted by p-dist */
+			return EXIT_FAILURE;
+
+	/* -d 0 keeps only seeds as good as the best one */
+	locs = getLocs(dists, n);
+	selectSeed(locs, 0, n);
+	cout << "Selected " << locs.size() << " seeds with maxDiff 0" << endl;
+	if(locs.size() != 3)
+		return EXIT_FAILURE;
+	for(vector<PTUnrooted::PTLoc>::const_iterator loc = locs.begin(); loc != locs.end(); ++loc)
+		if(loc->dist != 0.1)
+			return EXIT_FAILURE;
+
+	/* maxDiff within the candidates */
+	locs = getLocs(dists, n);
+	selectSeed(locs, 0.05, n);
+	cout << "Selected " << locs.size() << " seeds with maxDiff 0.05" << endl;
+	if(!(locs.size() == 4 && locs.back().id == 2))
+		return EXIT_FAILURE;
+
+	/* maxNSeed applied before maxDiff */
+	locs = getLocs(dists, n);
+	selectSeed(locs, inf, 2);
+	cout << "Selected " << locs.size() << " seeds with maxNSeed 2" << endl;
+	if(!(locs.size() == 2 && locs[0].dist == 0.1 && locs[1].dist == 0.1))
+		return EXIT_FAILURE;
+
+	/* nothing to select */
+	locs.clear();
+	selectSeed(locs, 0, n);
+	if(!locs.empty())
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -48,6 +48,16 @@ if [ $? == 0 ]
 		exit 1
 fi 
 
+echo "Running taxonomy assignment with read dereplication enabled ..."
+$SRCPATH/hmmufotu $DB $SIMFILE -o $ASSIGNFILE -v --derep --derep-batch 50
+if [ $? == 0 ]
+	then
+		echo "taxonomy assignment file generated"
+	else
+		echo "Failed to generate assignment file"
+		exit 1
+fi
+
 echo "Running taxonomy assignment with chimera checking enabled ..."
 $SRCPATH/hmmufotu $DB $SIMFILE -o $ASSIGNFILE -v -C --chimera-out $CHIMERAFILE
 if [ $? == 0 ]
@@ -89,4 +99,48 @@ if [ $? == 0 ]
 		exit 1
 fi 
 
+echo "Slicing database to a sub-region ..."
+SLICEDB="${DB}_500-800"
+$SRCPATH/hmmufotu-slice $DB -r 500-800 -o $SLICEDB -v
+if [ $? == 0 ]
+	then
+		echo "database sliced"
+	else
+		echo "Failed to slice database"
+		exit 1
+fi 
+
+echo "Running taxonomy assignment with the sliced database ..."
+$SRCPATH/hmmufotu-sim $SLICEDB ${SLICEDB}_sim.fasta -N $SIMNUM -S $SIMSEED -m 200 -s 20 -v && \
+$SRCPATH/hmmufotu $SLICEDB ${SLICEDB}_sim.fasta -o ${SLICEDB}_sim_assign.txt -v
+if [ $? == 0 ]
+	then
+		echo "taxonomy assignment file generated"
+	else
+		echo "Failed to generate assignment file"
+		exit 1
+fi 
+
+echo "Updating database with new reference sequences ..."
+UPDATEDB="${DB}_update"
+$SRCPATH/hmmufotu-sim $DB ${UPDATEDB}_ref.fasta -N 5 -S $SIMSEED -m 1400 -s 20 --prefix new -v && \
+$SRCPATH/hmmufotu-update $DB ${UPDATEDB}_ref.fasta -o $UPDATEDB -v
+if [ $? == 0 ]
+	then
+		echo "database updated"
+	else
+		echo "Failed to update database"
+		exit 1
+fi 
+
+echo "Running taxonomy assignment with the updated database ..."
+$SRCPATH/hmmufotu $UPDATEDB $SIMFILE -o ${UPDATEDB}_sim_assign.txt -v
+if [ $? == 0 ]
+	then
+		echo "taxonomy assignment file generated"
+	else
+		echo "Failed to generate assignment file"
+		exit 1
+fi 
+
 rm -f ${DB}*